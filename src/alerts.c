@@ -0,0 +1,522 @@
+#include <glib.h>
+#include <string.h>
+#include "zenmonitor.h"
+#include "alerts.h"
+
+// Threshold alerts
+//
+// Rules come from a key file, one group per rule:
+//
+//   [hot]
+//   sensor=CPU Temperature (tDie)
+//   above=90
+//   hysteresis=3
+//   for=5
+//   action=log;notify
+//
+// "above" / "below" take a value in the sensor's unit, or a percentage of
+// the sensor's max ("60%"). An optional "while" sensor with "while-above" /
+// "while-below" must hold as well. Sensors are resolved by label once, when
+// the sources are bound, so evaluating a rule is a couple of float compares
+// no matter how many sensors exist.
+//
+// A group with type=throttle is the built-in throttling detector, see
+// evaluate_throttle.
+
+#define ALERT_ACTION_LOG    (1 << 0)
+#define ALERT_ACTION_NOTIFY (1 << 1)
+#define ALERT_ACTION_EXEC   (1 << 2)
+
+#define THROTTLE_FREQ_LABEL "Average Effective Frequency"
+#define THROTTLE_BASELINE_WEIGHT 0.05
+
+typedef struct {
+    gchar *label;
+    SensorInit *sensor;
+    gboolean above;
+    gboolean relative;          // threshold and hysteresis are % of the sensor's max
+    gdouble threshold;
+    gdouble hysteresis;
+} AlertCondition;
+
+typedef struct {
+    gchar *name;
+    gboolean throttle;
+    gboolean enabled;
+    AlertCondition cond;
+    AlertCondition guard;       // "while", label is NULL when unused
+    gint64 duration;            // us the condition has to hold before firing
+    guint actions;
+    gchar **exec_argv;
+
+    gint64 pending_since;
+    gboolean active;
+
+    // Throttling detector
+    SensorInit *freq;           // average effective frequency, summed by msr
+    gchar *temp_label;
+    gchar *current_label;
+    SensorInit *temp;
+    SensorInit *current;
+    gdouble temp_limit;
+    gdouble current_limit;      // 0 = near the highest current seen
+    gdouble drop;
+    gdouble baseline;
+} AlertRule;
+
+static GPtrArray *rules = NULL;
+
+static gboolean parse_threshold(const gchar *text, gdouble *value, gboolean *relative) {
+    gchar *end;
+
+    *value = g_ascii_strtod(text, &end);
+    if (end == text)
+        return FALSE;
+
+    while (g_ascii_isspace(*end))
+        end++;
+
+    *relative = (*end == '%');
+    if (*relative)
+        end++;
+
+    return *end == 0;
+}
+
+static gboolean parse_condition(GKeyFile *kf, const gchar *group, const gchar *sensor_key,
+                                const gchar *above_key, const gchar *below_key,
+                                AlertCondition *c, GError **error) {
+    gchar *text;
+    gboolean ok;
+
+    c->label = g_key_file_get_string(kf, group, sensor_key, NULL);
+    if (!c->label)
+        return TRUE;
+
+    c->above = g_key_file_has_key(kf, group, above_key, NULL);
+    text = g_key_file_get_string(kf, group, c->above ? above_key : below_key, NULL);
+    if (!text) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                    "[%s] needs %s or %s", group, above_key, below_key);
+        return FALSE;
+    }
+
+    ok = parse_threshold(text, &c->threshold, &c->relative);
+    if (!ok)
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "[%s] invalid threshold \"%s\"", group, text);
+    g_free(text);
+
+    return ok;
+}
+
+static gboolean parse_actions(GKeyFile *kf, const gchar *group, AlertRule *r, GError **error) {
+    gchar **actions, *exec;
+    gsize i, n;
+
+    actions = g_key_file_get_string_list(kf, group, "action", &n, NULL);
+    if (!actions) {
+        r->actions = ALERT_ACTION_LOG;
+        return TRUE;
+    }
+
+    for (i = 0; i < n; i++) {
+        g_strstrip(actions[i]);
+        if (strcmp(actions[i], "log") == 0)
+            r->actions |= ALERT_ACTION_LOG;
+        else if (strcmp(actions[i], "notify") == 0)
+            r->actions |= ALERT_ACTION_NOTIFY;
+        else if (strcmp(actions[i], "exec") == 0)
+            r->actions |= ALERT_ACTION_EXEC;
+        else {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                        "[%s] unknown action \"%s\"", group, actions[i]);
+            g_strfreev(actions);
+            return FALSE;
+        }
+    }
+    g_strfreev(actions);
+
+    if (r->actions & ALERT_ACTION_EXEC) {
+        exec = g_key_file_get_string(kf, group, "exec", NULL);
+        if (!exec || !g_shell_parse_argv(exec, NULL, &r->exec_argv, error)) {
+            if (!exec)
+                g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                            "[%s] action exec needs an exec command", group);
+            g_free(exec);
+            return FALSE;
+        }
+        g_free(exec);
+    }
+
+    return TRUE;
+}
+
+static gdouble get_double(GKeyFile *kf, const gchar *group, const gchar *key, gdouble def) {
+    GError *error = NULL;
+    gdouble value;
+
+    value = g_key_file_get_double(kf, group, key, &error);
+    if (error) {
+        g_error_free(error);
+        return def;
+    }
+    return value;
+}
+
+static gboolean parse_rule_keys(GKeyFile *kf, const gchar *group, AlertRule *r, GError **error) {
+    gchar *type, *text;
+    gboolean relative;
+
+    r->duration = get_double(kf, group, "for", 0) * G_USEC_PER_SEC;
+
+    type = g_key_file_get_string(kf, group, "type", NULL);
+    r->throttle = g_strcmp0(type, "throttle") == 0;
+    if (type && !r->throttle) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                    "[%s] unknown type \"%s\"", group, type);
+        g_free(type);
+        return FALSE;
+    }
+    g_free(type);
+
+    if (!parse_actions(kf, group, r, error))
+        return FALSE;
+
+    if (r->throttle) {
+        r->temp_label = g_key_file_get_string(kf, group, "temperature", NULL);
+        r->current_label = g_key_file_get_string(kf, group, "current", NULL);
+        if (!r->current_label)
+            r->current_label = g_strdup("CPU Core Current (SVI2)");
+        r->temp_limit = get_double(kf, group, "temperature-limit", 90);
+        r->current_limit = get_double(kf, group, "current-limit", 0);
+
+        r->drop = 15;
+        text = g_key_file_get_string(kf, group, "drop", NULL);
+        if (text && !parse_threshold(text, &r->drop, &relative)) {
+            g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                        "[%s] invalid drop \"%s\"", group, text);
+            g_free(text);
+            return FALSE;
+        }
+        g_free(text);
+        r->drop /= 100.0;
+        if (!g_key_file_has_key(kf, group, "for", NULL))
+            r->duration = G_USEC_PER_SEC;
+        return TRUE;
+    }
+
+    if (!parse_condition(kf, group, "sensor", "above", "below", &r->cond, error) ||
+        !parse_condition(kf, group, "while", "while-above", "while-below", &r->guard, error))
+        return FALSE;
+
+    if (!r->cond.label) {
+        g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                    "[%s] needs a sensor", group);
+        return FALSE;
+    }
+    r->cond.hysteresis = get_double(kf, group, "hysteresis", 0);
+
+    return TRUE;
+}
+
+static void alert_rule_free(AlertRule *r) {
+    g_free(r->name);
+    g_strfreev(r->exec_argv);
+    g_free(r->cond.label);
+    g_free(r->guard.label);
+    g_free(r->temp_label);
+    g_free(r->current_label);
+    g_free(r);
+}
+
+static AlertRule* parse_rule(GKeyFile *kf, const gchar *group, GError **error) {
+    AlertRule *r = g_new0(AlertRule, 1);
+
+    r->name = g_strdup(group);
+    if (!parse_rule_keys(kf, group, r, error)) {
+        alert_rule_free(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+gboolean alerts_load(const gchar *filename) {
+    GKeyFile *kf;
+    GError *error = NULL;
+    AlertRule *r;
+    gchar **groups;
+    gsize i, n;
+
+    kf = g_key_file_new();
+    if (!g_key_file_load_from_file(kf, filename, G_KEY_FILE_NONE, &error)) {
+        g_printerr("alerts: %s: %s\n", filename, error->message);
+        g_error_free(error);
+        g_key_file_free(kf);
+        return FALSE;
+    }
+
+    rules = g_ptr_array_new();
+    groups = g_key_file_get_groups(kf, &n);
+    for (i = 0; i < n; i++) {
+        r = parse_rule(kf, groups[i], &error);
+        if (!r) {
+            g_printerr("alerts: %s: %s\n", filename, error->message);
+            g_error_free(error);
+            g_ptr_array_foreach(rules, (GFunc)alert_rule_free, NULL);
+            g_ptr_array_free(rules, TRUE);
+            rules = NULL;
+            g_strfreev(groups);
+            g_key_file_free(kf);
+            return FALSE;
+        }
+        g_ptr_array_add(rules, r);
+    }
+
+    g_strfreev(groups);
+    g_key_file_free(kf);
+    return TRUE;
+}
+
+static SensorInit* find_sensor(SensorSource *sources, const gchar *label) {
+    SensorSource *source;
+    GSList *node;
+
+    for (source = sources; source->drv; source++) {
+        if (!source->enabled)
+            continue;
+
+        for (node = source->sensors; node; node = node->next) {
+            if (g_strcmp0(((SensorInit*)node->data)->label, label) == 0)
+                return node->data;
+        }
+    }
+
+    return NULL;
+}
+
+static gboolean bind_condition(SensorSource *sources, AlertRule *r, AlertCondition *c) {
+    if (!c->label)
+        return TRUE;
+
+    c->sensor = find_sensor(sources, c->label);
+    if (!c->sensor) {
+        g_printerr("alerts: [%s] sensor \"%s\" not found, rule disabled\n", r->name, c->label);
+        return FALSE;
+    }
+
+    sensor_observe(c->sensor);
+    return TRUE;
+}
+
+static void bind_throttle(SensorSource *sources, AlertRule *r) {
+    r->freq = find_sensor(sources, THROTTLE_FREQ_LABEL);
+    if (!r->freq) {
+        g_printerr("alerts: [%s] no effective frequency sensors (MSR), detector disabled\n", r->name);
+        return;
+    }
+    sensor_observe(r->freq);
+
+    // Without temperature or current the detector cannot tell a cause, it
+    // still works with whichever of the two is there
+    // k10temp only has tDie when it differs from tCtl
+    if (r->temp_label)
+        r->temp = find_sensor(sources, r->temp_label);
+    else if (!(r->temp = find_sensor(sources, "CPU Temperature (tDie)")))
+        r->temp = find_sensor(sources, "CPU Temperature (tCtl)");
+    r->current = find_sensor(sources, r->current_label);
+    if (r->temp)
+        sensor_observe(r->temp);
+    if (r->current)
+        sensor_observe(r->current);
+    if (!r->temp && !r->current) {
+        g_printerr("alerts: [%s] neither a temperature nor \"%s\" found, detector disabled\n",
+                   r->name, r->current_label);
+        return;
+    }
+
+    r->enabled = TRUE;
+}
+
+void alerts_bind(SensorSource *sources) {
+    AlertRule *r;
+    guint i;
+
+    for (i = 0; rules && i < rules->len; i++) {
+        r = g_ptr_array_index(rules, i);
+        if (r->throttle)
+            bind_throttle(sources, r);
+        else
+            r->enabled = bind_condition(sources, r, &r->cond) && bind_condition(sources, r, &r->guard);
+    }
+}
+
+static void run_actions(AlertRule *r, gboolean fired, const gchar *message) {
+    gchar *notify_argv[] = { "notify-send", "-a", "zenmonitor", "Zen monitor", (gchar*)message, NULL };
+    gchar **envp;
+    GError *error = NULL;
+
+    if (r->actions & ALERT_ACTION_LOG)
+        g_printerr("alert: [%s] %s%s\n", r->name, fired ? "" : "cleared: ", message);
+
+    // Notifications and hooks only go out when a rule fires
+    if (!fired)
+        return;
+
+    if ((r->actions & ALERT_ACTION_NOTIFY) &&
+        !g_spawn_async(NULL, notify_argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL,
+                       NULL, NULL, NULL, &error)) {
+        g_printerr("alert: [%s] notify-send: %s\n", r->name, error->message);
+        g_clear_error(&error);
+    }
+
+    if (r->actions & ALERT_ACTION_EXEC) {
+        envp = g_get_environ();
+        envp = g_environ_setenv(envp, "ZENMONITOR_ALERT", r->name, TRUE);
+        envp = g_environ_setenv(envp, "ZENMONITOR_MESSAGE", message, TRUE);
+        if (!g_spawn_async(NULL, r->exec_argv, envp, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL, &error)) {
+            g_printerr("alert: [%s] %s: %s\n", r->name, r->exec_argv[0], error->message);
+            g_clear_error(&error);
+        }
+        g_strfreev(envp);
+    }
+}
+
+// Once active, a condition keeps holding until the value is back past the
+// hysteresis band
+static gboolean condition_holds(const AlertCondition *c, gboolean active) {
+    gdouble value = *c->sensor->value;
+    gdouble threshold = c->threshold, hysteresis = c->hysteresis;
+
+    if (value == ERROR_VALUE)
+        return FALSE;
+
+    if (c->relative) {
+        if (*c->sensor->max == ERROR_VALUE)
+            return FALSE;
+        threshold *= *c->sensor->max / 100.0;
+        hysteresis *= *c->sensor->max / 100.0;
+    }
+
+    if (!active)
+        hysteresis = 0;
+
+    return c->above ? value > threshold - hysteresis : value < threshold + hysteresis;
+}
+
+// Returns TRUE when the rule fired or cleared during this call
+static gboolean update_state(AlertRule *r, gboolean holds, gint64 now) {
+    if (!r->active) {
+        if (!holds) {
+            r->pending_since = 0;
+            return FALSE;
+        }
+        if (!r->pending_since)
+            r->pending_since = now;
+        if (now - r->pending_since < r->duration)
+            return FALSE;
+
+        r->active = TRUE;
+        return TRUE;
+    }
+
+    if (holds)
+        return FALSE;
+
+    r->active = FALSE;
+    r->pending_since = 0;
+    return TRUE;
+}
+
+static void evaluate_rule(AlertRule *r, gint64 now) {
+    gboolean holds;
+    gchar value[64], *message;
+
+    holds = condition_holds(&r->cond, r->active) &&
+            (!r->guard.sensor || condition_holds(&r->guard, r->active));
+    if (!update_state(r, holds, now))
+        return;
+
+    g_snprintf(value, sizeof value, r->cond.sensor->printf_format, *r->cond.sensor->value);
+    message = g_strdup_printf("%s is %s", r->cond.label, g_strstrip(value));
+    run_actions(r, r->active, message);
+    g_free(message);
+}
+
+// Throttling shows up as the average effective frequency falling well below
+// its recent level while temperature or SVI2 current sit at their limit.
+// A drop without either is an ordinary load change and does not fire.
+static void evaluate_throttle(AlertRule *r, gint64 now) {
+    gdouble freq, temp, current, current_limit;
+    gboolean dropped, thermal = FALSE, edc = FALSE;
+    gchar *message;
+
+    freq = *r->freq->value;
+    if (freq == ERROR_VALUE || freq <= 0)
+        return;
+
+    if (r->baseline == 0)
+        r->baseline = freq;
+
+    if (r->temp && *r->temp->value != ERROR_VALUE) {
+        temp = *r->temp->value;
+        thermal = temp >= r->temp_limit - (r->active ? 2 : 0);
+    }
+    if (r->current && *r->current->value != ERROR_VALUE) {
+        current = *r->current->value;
+        current_limit = r->current_limit > 0 ? r->current_limit : *r->current->max * 0.95;
+        edc = current >= current_limit;
+    }
+
+    // Released only once the frequency has recovered half of the drop
+    dropped = freq < r->baseline * (1 - (r->active ? r->drop / 2 : r->drop));
+
+    // The baseline follows the normal level, but not while throttled
+    if (!dropped)
+        r->baseline += (freq - r->baseline) * THROTTLE_BASELINE_WEIGHT;
+
+    if (!update_state(r, dropped && (thermal || edc), now))
+        return;
+
+    if (r->active)
+        message = g_strdup_printf("throttling (%s%s%s): effective frequency %.2f GHz, %.0f%% below %.2f GHz",
+                                  thermal ? "thermal" : "", thermal && edc ? ", " : "", edc ? "current limit" : "",
+                                  freq, (1 - freq / r->baseline) * 100, r->baseline);
+    else
+        message = g_strdup_printf("effective frequency back at %.2f GHz", freq);
+    run_actions(r, r->active, message);
+    g_free(message);
+}
+
+// Any rule bound to its sensors
+gboolean alerts_active() {
+    guint i;
+
+    for (i = 0; rules && i < rules->len; i++) {
+        if (((AlertRule*)g_ptr_array_index(rules, i))->enabled)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+void alerts_evaluate() {
+    AlertRule *r;
+    gint64 now;
+    guint i;
+
+    if (!rules)
+        return;
+
+    now = g_get_monotonic_time();
+    for (i = 0; i < rules->len; i++) {
+        r = g_ptr_array_index(rules, i);
+        if (!r->enabled)
+            continue;
+
+        if (r->throttle)
+            evaluate_throttle(r, now);
+        else
+            evaluate_rule(r, now);
+    }
+}
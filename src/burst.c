@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+#include <glib.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/sysinfo.h>
+#include "zenmonitor.h"
+#include "msr.h"
+#include "burst.h"
+
+// Upper bound for the capture buffer. The whole buffer is allocated and
+// touched before the capture starts, so this is also the peak memory use.
+#define BURST_MAX_BYTES (512UL * 1024 * 1024)
+#define BURST_MAX_RATE 1000
+
+typedef struct {
+    gint64 time;                // ns, CLOCK_MONOTONIC_RAW of the energy read
+    gulong energy;
+    gulong aperf;
+    gulong mperf;
+    gfloat fid;
+} BurstCoreSample;
+
+typedef struct {
+    guint cores;
+    guint samples;
+    guint rate;
+    gint cpu;
+    guint overruns;
+    guint captured;
+    gint64 *time;               // ns, CLOCK_MONOTONIC_RAW, same clock as the cores
+    BurstCoreSample *data;      // samples * cores
+} BurstCapture;
+
+static gint64 timespec_ns(const struct timespec *ts) {
+    return (gint64)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static void timespec_add_ns(struct timespec *ts, glong ns) {
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000) {
+        ts->tv_nsec -= 1000000000;
+        ts->tv_sec++;
+    }
+}
+
+static gpointer burst_thread(gpointer user_data) {
+    BurstCapture *bc = user_data;
+    BurstCoreSample *row;
+    struct timespec next, now, before, after;
+    cpu_set_t set;
+    glong period = 1000000000 / bc->rate;
+    guint s, i;
+
+    CPU_ZERO(&set);
+    CPU_SET(bc->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        g_printerr("burst: unable to pin sampler to cpu%d, running unpinned\n", bc->cpu);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (s = 0; s < bc->samples; s++) {
+        // Scheduled on CLOCK_MONOTONIC, clock_nanosleep does not take the raw clock
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+        bc->time[s] = timespec_ns(&now);
+
+        row = &bc->data[(gsize)s * bc->cores];
+        for (i = 0; i < bc->cores; i++) {
+            // Walking all cores takes a while, each core gets its own time
+            clock_gettime(CLOCK_MONOTONIC_RAW, &before);
+            row[i].energy = get_core_energy(i);
+            clock_gettime(CLOCK_MONOTONIC_RAW, &after);
+            row[i].time = (timespec_ns(&before) + timespec_ns(&after)) / 2;
+            row[i].aperf = get_core_aperf(i);
+            row[i].mperf = get_core_mperf(i);
+            row[i].fid = get_core_fid(i);
+        }
+
+        timespec_add_ns(&next, period);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_ns(&now) > timespec_ns(&next)) {
+            // Sampling took longer than one period; skip the missed slots
+            // instead of firing a burst of back-to-back reads.
+            bc->overruns++;
+            next = now;
+        }
+    }
+    bc->captured = s;
+
+    return NULL;
+}
+
+static gboolean burst_dump(BurstCapture *bc, const gchar *filename) {
+    BurstCoreSample *prev, *cur;
+    gdouble energy_unit, dt, core_dt;
+    FILE *f;
+    guint s, i;
+
+    f = fopen(filename, "w");
+    if (!f)
+        return FALSE;
+
+    energy_unit = get_energy_unit();
+
+    fprintf(f, "time_s");
+    for (i = 0; i < bc->cores; i++)
+        fprintf(f, ",core%u_power_w,core%u_fid_ghz,core%u_aperf_mhz,core%u_mperf_mhz", i, i, i, i);
+    fprintf(f, "\n");
+
+    for (s = 1; s < bc->captured; s++) {
+        dt = (bc->time[s] - bc->time[s - 1]) / 1e9;
+        if (dt <= 0)
+            continue;
+
+        prev = &bc->data[(gsize)(s - 1) * bc->cores];
+        cur = &bc->data[(gsize)s * bc->cores];
+
+        fprintf(f, "%.6f", (bc->time[s] - bc->time[0]) / 1e9);
+        for (i = 0; i < bc->cores; i++) {
+            core_dt = (cur[i].time - prev[i].time) / 1e9;
+            if (core_dt <= 0)
+                core_dt = dt;
+
+            // Core energy counters are 32 bits wide, let the subtraction wrap
+            fprintf(f, ",%.3f,%.3f,%.1f,%.1f",
+                    (guint32)(cur[i].energy - prev[i].energy) * energy_unit / core_dt,
+                    cur[i].fid,
+                    (cur[i].aperf - prev[i].aperf) / core_dt / 1e6,
+                    (cur[i].mperf - prev[i].mperf) / core_dt / 1e6);
+        }
+        fprintf(f, "\n");
+    }
+
+    return fclose(f) == 0;
+}
+
+gboolean burst_capture(gint seconds, guint rate, gint cpu, const gchar *filename) {
+    BurstCapture bc = { 0 };
+    GThread *thread;
+    guint64 samples;
+    gsize row, bytes;
+
+    if (!msr_init()) {
+        g_printerr("burst: MSR access is not available\n");
+        return FALSE;
+    }
+
+    if (cpu < 0 || cpu >= MIN(get_nprocs_conf(), CPU_SETSIZE)) {
+        g_printerr("burst: no cpu%d, the sampler CPU must be between 0 and %d\n",
+                   cpu, MIN(get_nprocs_conf(), CPU_SETSIZE) - 1);
+        return FALSE;
+    }
+
+    bc.cores = get_core_count();
+    bc.rate = CLAMP(rate, 1, BURST_MAX_RATE);
+    bc.cpu = cpu;
+
+    if (seconds <= 0) {
+        g_printerr("burst: duration must be positive\n");
+        return FALSE;
+    }
+
+    // Checked before narrowing, a long capture must not wrap to a short one
+    samples = (guint64)seconds * bc.rate;
+    row = sizeof(*bc.time) + bc.cores * sizeof(*bc.data);
+    if (samples > BURST_MAX_BYTES / row) {
+        g_printerr("burst: %d s at %u Hz needs %" G_GUINT64_FORMAT " MiB, limit is %lu MiB\n",
+                   seconds, bc.rate, (samples * row) >> 20, BURST_MAX_BYTES >> 20);
+        return FALSE;
+    }
+    bc.samples = samples;
+    bytes = (gsize)bc.samples * row;
+
+    // Allocate and fault in everything up front, the sampler never allocates.
+    bc.time = g_malloc(bc.samples * sizeof(*bc.time));
+    bc.data = g_malloc((gsize)bc.samples * bc.cores * sizeof(*bc.data));
+    memset(bc.time, 0, bc.samples * sizeof(*bc.time));
+    memset(bc.data, 0, (gsize)bc.samples * bc.cores * sizeof(*bc.data));
+    if (mlock(bc.time, bc.samples * sizeof(*bc.time)) != 0 ||
+        mlock(bc.data, (gsize)bc.samples * bc.cores * sizeof(*bc.data)) != 0)
+        g_printerr("burst: unable to lock the buffer in memory (%s), samples may be delayed by paging\n",
+                   g_strerror(errno));
+
+    g_print("burst: capturing %u cores for %d s at %u Hz on cpu%d (%" G_GSIZE_FORMAT " KiB buffer)\n",
+            bc.cores, seconds, bc.rate, bc.cpu, bytes >> 10);
+
+    thread = g_thread_new("zm-burst", burst_thread, &bc);
+    g_thread_join(thread);
+
+    if (bc.overruns)
+        g_print("burst: %u sampling periods overran\n", bc.overruns);
+
+    if (!burst_dump(&bc, filename)) {
+        g_printerr("burst: unable to write %s\n", filename);
+        g_free(bc.time);
+        g_free(bc.data);
+        return FALSE;
+    }
+    g_print("burst: %u samples written to %s\n", bc.captured, filename);
+
+    g_free(bc.time);
+    g_free(bc.data);
+    return TRUE;
+}
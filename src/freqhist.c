@@ -0,0 +1,105 @@
+#include <glib.h>
+#include <string.h>
+#include "zenmonitor.h"
+#include "freqhist.h"
+
+// Frequency residency
+//
+// Every update charges the time since the previous one to the bin of each
+// core's current effective frequency. The histogram is allocated once, an
+// update costs one division and two additions per core.
+
+#define FREQHIST_MSR_LABEL "Effective Frequency"
+#define FREQHIST_OS_LABEL "Frequency"
+
+static GPtrArray *find_sensors(SensorSource *sources, const gchar *suffix) {
+    GPtrArray *found = g_ptr_array_new();
+    SensorSource *source;
+    SensorInit *s;
+    GSList *node;
+
+    for (source = sources; source->drv; source++) {
+        if (!source->enabled)
+            continue;
+
+        for (node = source->sensors; node; node = node->next) {
+            s = node->data;
+            if (s->core >= 0 && g_str_has_suffix(s->label, suffix))
+                g_ptr_array_add(found, s);
+        }
+        if (found->len > 0)
+            break;
+    }
+
+    return found;
+}
+
+FreqHist *freqhist_new(SensorSource *sources, guint bin_mhz) {
+    GPtrArray *found;
+    FreqHist *h;
+    guint i;
+
+    // MSR effective frequency, or the cpufreq value when MSR is not available
+    found = find_sensors(sources, FREQHIST_MSR_LABEL);
+    if (found->len == 0) {
+        g_ptr_array_free(found, TRUE);
+        found = find_sensors(sources, FREQHIST_OS_LABEL);
+    }
+    if (found->len == 0) {
+        g_ptr_array_free(found, TRUE);
+        return NULL;
+    }
+
+    h = g_new0(FreqHist, 1);
+    h->cores = found->len;
+    h->bin_mhz = CLAMP(bin_mhz, 25, 1000);
+    h->bins = (FREQHIST_MAX_MHZ + h->bin_mhz - 1) / h->bin_mhz;
+    h->sensors = (SensorInit**)g_ptr_array_free(found, FALSE);
+    h->time = g_new0(guint64, (gsize)h->cores * h->bins);
+    h->total = g_new0(guint64, h->cores);
+
+    for (i = 0; i < h->cores; i++)
+        sensor_observe(h->sensors[i]);
+
+    h->last_update = g_get_monotonic_time();
+    return h;
+}
+
+void freqhist_update(FreqHist *h) {
+    gint64 now = g_get_monotonic_time();
+    guint64 dt = now - h->last_update;
+    gfloat ghz;
+    guint i, bin;
+
+    h->last_update = now;
+    for (i = 0; i < h->cores; i++) {
+        ghz = *h->sensors[i]->value;
+        if (ghz == ERROR_VALUE || ghz <= 0)
+            continue;
+
+        bin = MIN((guint)(ghz * 1000 / h->bin_mhz), h->bins - 1);
+        h->time[(gsize)i * h->bins + bin] += dt;
+        h->total[i] += dt;
+    }
+}
+
+void freqhist_reset(FreqHist *h) {
+    memset(h->time, 0, (gsize)h->cores * h->bins * sizeof(*h->time));
+    memset(h->total, 0, h->cores * sizeof(*h->total));
+    h->last_update = g_get_monotonic_time();
+}
+
+void freqhist_free(FreqHist *h) {
+    guint i;
+
+    if (!h)
+        return;
+
+    for (i = 0; i < h->cores; i++)
+        sensor_unobserve(h->sensors[i]);
+
+    g_free(h->sensors);
+    g_free(h->time);
+    g_free(h->total);
+    g_free(h);
+}
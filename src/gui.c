@@ -1,14 +1,29 @@
 #include <cpuid.h>
+#include <math.h>
 #include <gtk/gtk.h>
 #include "gui.h"
 #include "zenmonitor.h"
+#include "procpower.h"
+#include "alerts.h"
+#include "freqhist.h"
+#include "manifest.h"
 
 GtkWidget *window;
 
 static GtkTreeModel *model = NULL;
+static GtkTreeView *sensor_view = NULL;
+static gboolean interest_dirty = TRUE;
 static guint timeout = 0;
 static SensorSource *sensor_sources;
 static const guint defaultHeight = 350;
+static GtkListStore *proc_store = NULL;
+static FreqHist *freq_hist = NULL;
+static GtkWidget *hist_area = NULL;
+static GtkWidget *hist_btn = NULL;
+static GtkWidget *top_btn = NULL;
+
+// Rows that are expanded up front when the whole tree does not fit
+#define GUI_EXPAND_ALL_ROWS 64
 
 enum {
     COLUMN_NAME,
@@ -16,92 +31,749 @@ enum {
     COLUMN_VALUE,
     COLUMN_MIN,
     COLUMN_MAX,
+    COLUMN_GROUP,
     NUM_COLUMNS
 };
 
-static void init_sensors() {
+enum {
+    TOP_COLUMN_RANK,
+    TOP_COLUMN_NAME,
+    TOP_COLUMN_VALUE,
+    TOP_COLUMN_MIN,
+    TOP_COLUMN_MAX,
+    TOP_NUM_COLUMNS
+};
+
+enum {
+    PROC_COLUMN_PID,
+    PROC_COLUMN_NAME,
+    PROC_COLUMN_POWER,
+    PROC_NUM_COLUMNS
+};
+
+typedef enum {
+    GROUP_SOURCE,
+    GROUP_NODE,
+    GROUP_CCX,
+    GROUP_CORE
+} GroupKind;
+
+// One aggregate shown on a group row, per distinct (format, aggregate)
+// among the sensors below it
+typedef struct {
+    const gchar *printf_format;
+    SensorAggregate aggregate;
+    GArray *members;            // guint, indices into rows
+    gfloat value;
+    gfloat min;
+    gfloat max;
+} GuiSummary;
+
+typedef struct _GuiGroup {
+    GtkTreeIter iter;
+    struct _GuiGroup *parent;
+    GroupKind kind;
+    gint id;
+    gboolean expanded;
+    GPtrArray *children;        // GuiGroup
+    GArray *summaries;          // GuiSummary, empty for source rows
+} GuiGroup;
+
+// Tree store iters persist, so rows are addressed directly instead of
+// walking the model in step with the sensor lists
+typedef struct {
     GtkTreeIter iter;
+    GuiGroup *parent;
+    SensorInit *sensor;
+    gboolean observed;
+    gboolean wanted;
+    gboolean shown;
+    gboolean stale;
+    gfloat value;
+    gfloat min;
+    gfloat max;
+} GuiRow;
+
+static GPtrArray *groups = NULL;    // GuiGroup, parents before children
+static GArray *rows = NULL;         // GuiRow
+
+// Sources initialise in their own threads while the window is already up.
+// Everything else only touches a source once the main loop has seen it finish.
+static gboolean *ready = NULL;
+static GuiGroup **roots = NULL;
+static guint pending = 0;
+
+static gboolean source_ready(SensorSource *source) {
+    return ready && ready[source - sensor_sources];
+}
+
+static GuiGroup* group_new(GuiGroup *parent, GroupKind kind, gint id, const gchar *label) {
+    GuiGroup *g = g_new0(GuiGroup, 1);
+
+    g->parent = parent;
+    g->kind = kind;
+    g->id = id;
+    g->children = g_ptr_array_new();
+    g->summaries = g_array_new(FALSE, FALSE, sizeof(GuiSummary));
+
+    gtk_tree_store_append(GTK_TREE_STORE(model), &g->iter, parent ? &parent->iter : NULL);
+    gtk_tree_store_set(GTK_TREE_STORE(model), &g->iter,
+                       COLUMN_NAME,  label,
+                       COLUMN_GROUP, g,
+                       -1);
+
+    if (parent)
+        g_ptr_array_add(parent->children, g);
+    g_ptr_array_add(groups, g);
+    return g;
+}
+
+static GuiGroup* group_child(GuiGroup *parent, GroupKind kind, gint id) {
+    GuiGroup *g;
+    gchar *label;
+    guint i;
+
+    for (i = 0; i < parent->children->len; i++) {
+        g = g_ptr_array_index(parent->children, i);
+        if (g->kind == kind && g->id == id)
+            return g;
+    }
+
+    label = g_strdup_printf(kind == GROUP_NODE ? "Node %d" : kind == GROUP_CCX ? "CCX %d" : "Core %d", id);
+    g = group_new(parent, kind, id, label);
+    g_free(label);
+    return g;
+}
+
+// Registers a row with the summaries of every group above it
+static void group_add_row(GuiGroup *g, guint index) {
+    const SensorInit *data = g_array_index(rows, GuiRow, index).sensor;
+    GuiSummary *sum, new_sum;
+    guint i;
+
+    if (data->aggregate == SENSOR_AGG_NONE)
+        return;
+
+    for (; g && g->kind != GROUP_SOURCE; g = g->parent) {
+        sum = NULL;
+        for (i = 0; i < g->summaries->len; i++) {
+            sum = &g_array_index(g->summaries, GuiSummary, i);
+            if (sum->aggregate == data->aggregate && g_strcmp0(sum->printf_format, data->printf_format) == 0)
+                break;
+            sum = NULL;
+        }
+
+        if (!sum) {
+            new_sum.printf_format = data->printf_format;
+            new_sum.aggregate = data->aggregate;
+            new_sum.members = g_array_new(FALSE, FALSE, sizeof(guint));
+            new_sum.value = new_sum.min = new_sum.max = ERROR_VALUE;
+            g_array_append_val(g->summaries, new_sum);
+            sum = &g_array_index(g->summaries, GuiSummary, g->summaries->len - 1);
+        }
+        g_array_append_val(sum->members, index);
+    }
+}
+
+static gpointer core_key(const SensorInit *data) {
+    return GUINT_TO_POINTER(((guint)(data->node + 1) << 16) | (guint)(data->core + 1));
+}
+
+static GuiGroup* init_source_rows(SensorSource *source) {
+    GHashTable *per_core;
     GSList *sensor;
-    GtkListStore *store;
-    SensorSource *source;
-    const SensorInit *data;
-    guint i = 0;
+    SensorInit *data;
+    GuiGroup *root, *g;
+    GuiRow row;
+    gint first_node = -1;
+    gboolean multi_node = FALSE;
+    guint count;
 
-    store = GTK_LIST_STORE(model);
-    for (source = sensor_sources; source->drv; source++) {
-        if (source->func_init()){
-            source->sensors = source->func_get_sensors();
-            if (source->sensors != NULL) {
-                source->enabled = TRUE;
-
-                sensor = source->sensors;
-                while (sensor) {
-                    data = (SensorInit*)sensor->data;
-                    gtk_list_store_append(store, &iter);
-                    gtk_list_store_set(store, &iter,
-                                       COLUMN_NAME,  data->label,
-                                       COLUMN_HINT,  data->hint,
-                                       COLUMN_VALUE, " --- ",
-                                       COLUMN_MIN,   " --- ",
-                                       COLUMN_MAX,   " --- ",
-                                       -1);
-                    sensor = sensor->next;
-                    i++;
-                }
-            }
+    // Sensors per core, a core only gets its own group when it has several
+    per_core = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (sensor = source->sensors; sensor; sensor = sensor->next) {
+        data = sensor->data;
+        if (data->node >= 0) {
+            if (first_node < 0)
+                first_node = data->node;
+            else if (data->node != first_node)
+                multi_node = TRUE;
+        }
+        if (data->core >= 0) {
+            count = GPOINTER_TO_UINT(g_hash_table_lookup(per_core, core_key(data)));
+            g_hash_table_insert(per_core, core_key(data), GUINT_TO_POINTER(count + 1));
         }
     }
+
+    root = group_new(NULL, GROUP_SOURCE, 0, source->drv);
+
+    for (sensor = source->sensors; sensor; sensor = sensor->next) {
+        data = sensor->data;
+        g = root;
+
+        if (multi_node && data->node >= 0)
+            g = group_child(g, GROUP_NODE, data->node);
+        if (data->ccx >= 0)
+            g = group_child(g, GROUP_CCX, data->ccx);
+        if (data->core >= 0) {
+            if (GPOINTER_TO_UINT(g_hash_table_lookup(per_core, core_key(data))) > 1)
+                g = group_child(g, GROUP_CORE, data->core);
+        }
+
+        row.parent = g;
+        row.sensor = data;
+        row.observed = row.wanted = FALSE;
+        row.shown = row.stale = FALSE;
+        row.value = row.min = row.max = ERROR_VALUE;
+        gtk_tree_store_append(GTK_TREE_STORE(model), &row.iter, &g->iter);
+        gtk_tree_store_set(GTK_TREE_STORE(model), &row.iter,
+                           COLUMN_NAME,  data->label,
+                           COLUMN_HINT,  data->hint,
+                           COLUMN_VALUE, " --- ",
+                           COLUMN_MIN,   " --- ",
+                           COLUMN_MAX,   " --- ",
+                           -1);
+        g_array_append_val(rows, row);
+
+        if (g != root)
+            group_add_row(g, rows->len - 1);
+    }
+
+    g_hash_table_destroy(per_core);
+    return root;
 }
 
 static GtkTreeModel* create_model (void) {
-    GtkListStore *store;
-    store = gtk_list_store_new (NUM_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    GtkTreeStore *store;
+    store = gtk_tree_store_new (NUM_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+                                G_TYPE_STRING, G_TYPE_STRING, G_TYPE_POINTER);
     return GTK_TREE_MODEL (store);
 }
 
-static void set_list_column_value(float num, const gchar *printf_format, GtkTreeIter *iter, gint column){
-    gchar *value;
+static void format_value(gchar *buf, gsize size, float num, const gchar *printf_format, gboolean stale) {
     if (num != ERROR_VALUE)
-        value = g_strdup_printf(printf_format, num);
+        g_snprintf(buf, size, printf_format, num);
     else
-        value = g_strdup("    ? ? ?");
-    gtk_list_store_set(GTK_LIST_STORE (model), iter, column, value, -1);
-    g_free(value);
+        g_strlcpy(buf, "    ? ? ?", size);
+
+    // Min/max that missed samples while nobody was looking at the sensor,
+    // marked after the value since formats do not all start with a space
+    if (stale)
+        g_strlcat(buf, "~", size);
 }
 
-static gboolean update_data (gpointer data) {
+static void set_list_column_value(float num, const gchar *printf_format, gboolean stale, GtkTreeIter *iter, gint column){
+    gchar value[64];
+
+    format_value(value, sizeof value, num, printf_format, stale);
+    gtk_tree_store_set(GTK_TREE_STORE (model), iter, column, value, -1);
+}
+
+// Children of g are on screen only when g and everything above it is expanded
+static gboolean group_open(const GuiGroup *g) {
+    for (; g; g = g->parent) {
+        if (!g->expanded)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static void update_summary(GuiSummary *sum) {
+    const SensorInit *s;
+    gfloat acc = 0;
+    guint i, n = 0;
+
+    for (i = 0; i < sum->members->len; i++) {
+        s = g_array_index(rows, GuiRow, g_array_index(sum->members, guint, i)).sensor;
+        if (*s->value == ERROR_VALUE)
+            continue;
+
+        if (sum->aggregate == SENSOR_AGG_MAX)
+            acc = n ? MAX(acc, *s->value) : *s->value;
+        else
+            acc += *s->value;
+        n++;
+    }
+
+    if (n == 0) {
+        sum->value = ERROR_VALUE;
+        return;
+    }
+
+    sum->value = sum->aggregate == SENSOR_AGG_AVG ? acc / n : acc;
+    if (sum->min == ERROR_VALUE || sum->value < sum->min)
+        sum->min = sum->value;
+    if (sum->max == ERROR_VALUE || sum->value > sum->max)
+        sum->max = sum->value;
+}
+
+static void set_summary_column(GuiGroup *g, gint column) {
+    GString *text = g_string_new(NULL);
+    GuiSummary *sum;
+    gchar buf[64];
+    gboolean stale;
+    gfloat num;
+    guint i, j;
+
+    for (i = 0; i < g->summaries->len; i++) {
+        sum = &g_array_index(g->summaries, GuiSummary, i);
+        num = column == COLUMN_VALUE ? sum->value : column == COLUMN_MIN ? sum->min : sum->max;
+
+        stale = FALSE;
+        for (j = 0; column != COLUMN_VALUE && j < sum->members->len && !stale; j++)
+            stale = g_array_index(rows, GuiRow, g_array_index(sum->members, guint, j)).sensor->stale;
+
+        format_value(buf, sizeof buf, num, sum->printf_format, stale);
+        if (i > 0)
+            g_string_append(text, " / ");
+        g_string_append(text, g_strstrip(buf));
+    }
+
+    gtk_tree_store_set(GTK_TREE_STORE(model), &g->iter, column, text->str, -1);
+    g_string_free(text, TRUE);
+}
+
+// Formats only what is on screen; rows inside collapsed groups keep their
+// old text until they are expanded again
+static void refresh_view() {
+    GuiGroup *g;
+    GuiRow *row;
+    const SensorInit *s;
+    guint i;
+
+    for (i = 0; i < groups->len; i++) {
+        g = g_ptr_array_index(groups, i);
+        if (g->summaries->len == 0 || !group_open(g->parent))
+            continue;
+
+        set_summary_column(g, COLUMN_VALUE);
+        set_summary_column(g, COLUMN_MIN);
+        set_summary_column(g, COLUMN_MAX);
+    }
+
+    for (i = 0; i < rows->len; i++) {
+        row = &g_array_index(rows, GuiRow, i);
+        if (!group_open(row->parent))
+            continue;
+
+        s = row->sensor;
+        if (!row->shown || *s->value != row->value)
+            set_list_column_value(*s->value, s->printf_format, FALSE, &row->iter, COLUMN_VALUE);
+        if (!row->shown || *s->min != row->min || s->stale != row->stale)
+            set_list_column_value(*s->min, s->printf_format, s->stale, &row->iter, COLUMN_MIN);
+        if (!row->shown || *s->max != row->max || s->stale != row->stale)
+            set_list_column_value(*s->max, s->printf_format, s->stale, &row->iter, COLUMN_MAX);
+
+        row->value = *s->value;
+        row->min = *s->min;
+        row->max = *s->max;
+        row->stale = s->stale;
+        row->shown = TRUE;
+    }
+}
+
+static void update_proc_window() {
+    ProcPower top[PROCPOWER_TOP];
+    GtkTreeIter iter;
+    gboolean valid;
+    gchar *power;
+    guint n, i;
+
+    procpower_update();
+    n = procpower_top(top, PROCPOWER_TOP);
+
+    valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(proc_store), &iter);
+    for (i = 0; i < n; i++) {
+        if (!valid)
+            gtk_list_store_append(proc_store, &iter);
+
+        power = g_strdup_printf(" %8.3f W", top[i].power);
+        gtk_list_store_set(proc_store, &iter,
+                           PROC_COLUMN_PID,   top[i].pid,
+                           PROC_COLUMN_NAME,  top[i].comm,
+                           PROC_COLUMN_POWER, power,
+                           -1);
+        g_free(power);
+
+        valid = valid && gtk_tree_model_iter_next(GTK_TREE_MODEL(proc_store), &iter);
+    }
+    while (valid)
+        valid = gtk_list_store_remove(proc_store, &iter);
+}
+
+static gboolean iter_on_screen(GtkTreeIter *iter, GtkTreePath *start, GtkTreePath *end) {
+    GtkTreePath *path;
+    gboolean result;
+
+    if (!start)
+        return TRUE;
+
+    path = gtk_tree_model_get_path(model, iter);
+    result = gtk_tree_path_compare(path, start) >= 0 && gtk_tree_path_compare(path, end) <= 0;
+    gtk_tree_path_free(path);
+
+    return result;
+}
+
+// A sensor is read from the hardware only while its row is scrolled into
+// view inside expanded groups, or it feeds a summary that is. What is on
+// screen only changes on expand, collapse, scroll and resize, which set
+// interest_dirty; the next tick recomputes it before reading.
+static void update_interest() {
+    GtkTreePath *start = NULL, *end = NULL;
+    GuiSummary *sum;
+    GuiGroup *g;
+    GuiRow *row;
+    guint i, j, k;
+
+    if (!gtk_tree_view_get_visible_range(sensor_view, &start, &end))
+        start = end = NULL;
+
+    for (i = 0; i < rows->len; i++) {
+        row = &g_array_index(rows, GuiRow, i);
+        row->wanted = group_open(row->parent) && iter_on_screen(&row->iter, start, end);
+    }
+
+    for (i = 0; i < groups->len; i++) {
+        g = g_ptr_array_index(groups, i);
+        if (g->summaries->len == 0 || !group_open(g->parent) || !iter_on_screen(&g->iter, start, end))
+            continue;
+
+        for (j = 0; j < g->summaries->len; j++) {
+            sum = &g_array_index(g->summaries, GuiSummary, j);
+            for (k = 0; k < sum->members->len; k++)
+                g_array_index(rows, GuiRow, g_array_index(sum->members, guint, k)).wanted = TRUE;
+        }
+    }
+
+    for (i = 0; i < rows->len; i++) {
+        row = &g_array_index(rows, GuiRow, i);
+        if (row->wanted == row->observed)
+            continue;
+
+        if (row->wanted)
+            sensor_observe(row->sensor);
+        else
+            sensor_unobserve(row->sensor);
+        row->observed = row->wanted;
+    }
+
+    gtk_tree_path_free(start);
+    gtk_tree_path_free(end);
+    interest_dirty = FALSE;
+}
+
+static void view_scrolled(GtkAdjustment *adjustment, gpointer user_data) {
+    interest_dirty = TRUE;
+}
+
+// Top-N window. Sensors whose labels differ only in numbers ("Core # Power")
+// form a metric; its sensors are ranked by Value, Min or Max. The ranking
+// is kept with an insertion sort, which is linear while it barely changes
+// between ticks. Rows that left the top are removed, new ones appended, and
+// the store is put in ranking order with a single reorder.
+typedef struct {
+    gchar *key;
+    GPtrArray *sensors;         // SensorInit
+} TopMetric;
+
+typedef struct {
+    SensorInit *sensor;
     GtkTreeIter iter;
+    guint rank;
+    gboolean kept;              // still in the top this tick
+    guint slot;                 // store position before the reorder
+    gfloat value;
+    gfloat min;
+    gfloat max;
+    gboolean stale;
+} TopRow;
+
+static const gchar *top_orders[] = {
+    "Highest Value", "Highest Min", "Highest Max",
+    "Lowest Value", "Lowest Min", "Lowest Max",
+    NULL
+};
+
+static GtkListStore *top_store = NULL;
+static GPtrArray *top_metrics = NULL;      // TopMetric
+static TopMetric *top_metric = NULL;
+static GPtrArray *top_ranking = NULL;      // SensorInit of top_metric, best first
+static GPtrArray *top_shown = NULL;        // TopRow, in store order
+static GHashTable *top_rows = NULL;        // SensorInit -> TopRow of top_shown
+static gint top_order = 0;                 // index into top_orders
+static guint top_count = 10;
+
+static gchar* metric_key(const gchar *label) {
+    GString *key = g_string_new(NULL);
+
+    while (*label) {
+        if (g_ascii_isdigit(*label)) {
+            g_string_append_c(key, '#');
+            while (g_ascii_isdigit(*label))
+                label++;
+        }
+        else {
+            g_string_append_c(key, *label++);
+        }
+    }
+    return g_string_free(key, FALSE);
+}
+
+static void build_top_metrics() {
+    GHashTable *by_key;
+    SensorSource *source;
+    TopMetric *m;
     GSList *node;
+    gchar *key;
+    guint i;
+
+    top_metrics = g_ptr_array_new();
+    by_key = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (source = sensor_sources; source->drv; source++) {
+        if (!source_ready(source) || !source->enabled)
+            continue;
+
+        for (node = source->sensors; node; node = node->next) {
+            key = metric_key(((SensorInit*)node->data)->label);
+            m = g_hash_table_lookup(by_key, key);
+            if (!m) {
+                m = g_new0(TopMetric, 1);
+                m->key = key;
+                m->sensors = g_ptr_array_new();
+                g_hash_table_insert(by_key, m->key, m);
+                g_ptr_array_add(top_metrics, m);
+            }
+            else {
+                g_free(key);
+            }
+            g_ptr_array_add(m->sensors, node->data);
+        }
+    }
+    g_hash_table_destroy(by_key);
+
+    // Ranking a single sensor is pointless
+    for (i = top_metrics->len; i-- > 0;) {
+        m = g_ptr_array_index(top_metrics, i);
+        if (m->sensors->len < 2) {
+            g_ptr_array_free(m->sensors, TRUE);
+            g_free(m->key);
+            g_free(m);
+            g_ptr_array_remove_index(top_metrics, i);
+        }
+    }
+}
+
+static gfloat top_key(const SensorInit *s) {
+    switch (top_order % 3) {
+        case 1:  return *s->min;
+        case 2:  return *s->max;
+        default: return *s->value;
+    }
+}
+
+// Unreadable sensors go last whichever way the ranking goes
+static gboolean ranks_above(const SensorInit *a, const SensorInit *b) {
+    gfloat x = top_key(a), y = top_key(b);
+
+    if (x == ERROR_VALUE || y == ERROR_VALUE)
+        return x != ERROR_VALUE && y == ERROR_VALUE;
+    return top_order < 3 ? x > y : x < y;
+}
+
+static void rank_sensors() {
+    gpointer *p = top_ranking->pdata, s;
+    guint i, j;
+
+    for (i = 1; i < top_ranking->len; i++) {
+        s = p[i];
+        for (j = i; j > 0 && ranks_above(s, p[j - 1]); j--)
+            p[j] = p[j - 1];
+        p[j] = s;
+    }
+}
+
+static void clear_top_rows() {
+    guint i;
+
+    for (i = 0; i < top_shown->len; i++)
+        g_free(g_ptr_array_index(top_shown, i));
+    g_ptr_array_set_size(top_shown, 0);
+    g_hash_table_remove_all(top_rows);
+    gtk_list_store_clear(top_store);
+}
+
+static void set_top_value(TopRow *row, gint column, gfloat num, gfloat *shown, gboolean stale) {
+    gchar buf[64];
+
+    if (num == *shown && (column == TOP_COLUMN_VALUE || stale == row->stale))
+        return;
+
+    *shown = num;
+    format_value(buf, sizeof buf, num, row->sensor->printf_format, stale && column != TOP_COLUMN_VALUE);
+    gtk_list_store_set(top_store, &row->iter, column, buf, -1);
+}
+
+static void update_top() {
+    TopRow *row;
+    SensorInit *s;
+    gboolean moved = FALSE;
+    gint *order;
+    guint limit, i, j;
+
+    rank_sensors();
+    limit = MIN(top_count, top_ranking->len);
+
+    // Sensors new to the top are appended, the reorder puts them in place
+    for (i = 0; i < limit; i++) {
+        s = g_ptr_array_index(top_ranking, i);
+        row = g_hash_table_lookup(top_rows, s);
+        if (!row) {
+            row = g_new0(TopRow, 1);
+            row->sensor = s;
+            row->value = row->min = row->max = NAN;
+            gtk_list_store_append(top_store, &row->iter);
+            gtk_list_store_set(top_store, &row->iter, TOP_COLUMN_NAME, s->label, -1);
+            g_hash_table_insert(top_rows, s, row);
+            g_ptr_array_add(top_shown, row);
+        }
+        row->kept = TRUE;
+    }
+
+    // Rows that dropped out of the top
+    for (i = j = 0; i < top_shown->len; i++) {
+        row = g_ptr_array_index(top_shown, i);
+        if (!row->kept) {
+            gtk_list_store_remove(top_store, &row->iter);
+            g_hash_table_remove(top_rows, row->sensor);
+            g_free(row);
+            continue;
+        }
+        row->kept = FALSE;
+        top_shown->pdata[j++] = row;
+    }
+    g_ptr_array_set_size(top_shown, j);
+
+    // order[new position] = old position, as gtk_list_store_reorder wants it.
+    // The store position of each row is its index in top_shown.
+    order = g_new(gint, limit);
+    for (i = 0; i < limit; i++)
+        ((TopRow*)g_ptr_array_index(top_shown, i))->slot = i;
+    for (i = 0; i < limit; i++) {
+        row = g_hash_table_lookup(top_rows, g_ptr_array_index(top_ranking, i));
+        order[i] = row->slot;
+        moved |= order[i] != (gint)i;
+        top_shown->pdata[i] = row;
+    }
+    if (moved)
+        gtk_list_store_reorder(top_store, order);
+    g_free(order);
+
+    for (i = 0; i < top_shown->len; i++) {
+        row = g_ptr_array_index(top_shown, i);
+        s = row->sensor;
+
+        if (row->rank != i + 1) {
+            row->rank = i + 1;
+            gtk_list_store_set(top_store, &row->iter, TOP_COLUMN_RANK, row->rank, -1);
+        }
+
+        set_top_value(row, TOP_COLUMN_VALUE, *s->value, &row->value, s->stale);
+        set_top_value(row, TOP_COLUMN_MIN, *s->min, &row->min, s->stale);
+        set_top_value(row, TOP_COLUMN_MAX, *s->max, &row->max, s->stale);
+        row->stale = s->stale;
+    }
+}
+
+static gboolean update_data (gpointer data) {
     SensorSource *source;
-    const SensorInit *sensorData;
+    GuiGroup *g;
+    guint i, j;
 
-    if (model == NULL)
+    if (model == NULL || rows == NULL)
         return G_SOURCE_REMOVE;
 
-    if (!gtk_tree_model_get_iter_first (model, &iter))
-        return G_SOURCE_REMOVE;
+    if (interest_dirty)
+        update_interest();
 
     for (source = sensor_sources; source->drv; source++) {
-        if (!source->enabled)
+        if (source_ready(source))
+            source->func_update();
+    }
+
+    // Summaries keep their own min/max from every sample their sensors get.
+    // Groups inside collapsed ones are not shown and their sensors not read.
+    for (i = 0; i < groups->len; i++) {
+        g = g_ptr_array_index(groups, i);
+        if (!group_open(g->parent))
             continue;
-            
-        source->func_update();
-        if (source->sensors){
-            node = source->sensors;
-
-            while(node) {
-                sensorData = (SensorInit*)node->data;
-                set_list_column_value(*(sensorData->value), sensorData->printf_format, &iter, COLUMN_VALUE);
-                set_list_column_value(*(sensorData->min), sensorData->printf_format, &iter, COLUMN_MIN);
-                set_list_column_value(*(sensorData->max), sensorData->printf_format, &iter, COLUMN_MAX);
-
-                node = node->next;
-                if (!gtk_tree_model_iter_next(model, &iter))
-                    break;
+        for (j = 0; j < g->summaries->len; j++)
+            update_summary(&g_array_index(g->summaries, GuiSummary, j));
+    }
+
+    alerts_evaluate();
+
+    refresh_view();
+
+    if (proc_store)
+        update_proc_window();
+
+    if (freq_hist) {
+        freqhist_update(freq_hist);
+        gtk_widget_queue_draw(hist_area);
+    }
+
+    if (top_metric)
+        update_top();
+
+    return G_SOURCE_CONTINUE;
+}
+
+static GuiGroup* group_from_iter(GtkTreeIter *iter) {
+    GuiGroup *g = NULL;
+
+    gtk_tree_model_get(model, iter, COLUMN_GROUP, &g, -1);
+    return g;
+}
+
+static void row_expanded(GtkTreeView *treeview, GtkTreeIter *iter, GtkTreePath *path, gpointer user_data) {
+    GuiGroup *g = group_from_iter(iter);
+
+    if (!g)
+        return;
+
+    g->expanded = TRUE;
+    interest_dirty = TRUE;
+    if (rows && group_open(g))
+        refresh_view();
+}
+
+static void row_collapsed(GtkTreeView *treeview, GtkTreeIter *iter, GtkTreePath *path, gpointer user_data) {
+    GuiGroup *g = group_from_iter(iter), *d, *a;
+    GuiRow *row;
+    guint i;
+
+    if (!g)
+        return;
+    interest_dirty = TRUE;
+
+    // GtkTreeView forgets the expansion of everything below a collapsed row
+    for (i = 0; i < groups->len; i++) {
+        d = g_ptr_array_index(groups, i);
+        for (a = d; a; a = a->parent) {
+            if (a == g) {
+                d->expanded = FALSE;
+                break;
             }
         }
     }
-    return G_SOURCE_CONTINUE;
+
+    for (i = 0; i < rows->len; i++) {
+        row = &g_array_index(rows, GuiRow, i);
+        if (!group_open(row->parent))
+            row->shown = FALSE;
+    }
 }
 
 static void add_columns (GtkTreeView *treeview) {
@@ -160,32 +832,373 @@ static void about_btn_clicked(GtkButton *button, gpointer user_data) {
 
 static void clear_btn_clicked(GtkButton *button, gpointer user_data) {
     SensorSource *source;
+    GuiSummary *sum;
+    GuiGroup *g;
+    guint i, j;
 
     for (source = sensor_sources; source->drv; source++) {
-        if (!source->enabled)
+        if (!source_ready(source))
+            continue;
+
+        sensor_source_clear_minmax(source);
+    }
+
+    for (i = 0; groups && i < groups->len; i++) {
+        g = g_ptr_array_index(groups, i);
+        for (j = 0; j < g->summaries->len; j++) {
+            sum = &g_array_index(g->summaries, GuiSummary, j);
+            sum->min = sum->max = sum->value;
+        }
+    }
+}
+
+static void proc_window_destroyed(GtkWidget *widget, gpointer user_data) {
+    procpower_set_active(FALSE);
+    proc_store = NULL;
+}
+
+static void proc_btn_clicked(GtkButton *button, gpointer user_data) {
+    GtkWidget *proc_window;
+    GtkWidget *treeview;
+    GtkWidget *sw;
+    GtkWidget *dialog;
+    GtkCellRenderer *renderer;
+    GtkTreeViewColumn *column;
+
+    if (proc_store)
+        return;
+
+    if (!procpower_init()) {
+        dialog = gtk_message_dialog_new(GTK_WINDOW (window),
+                                        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                        GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                        "Process power needs Core Power from the MSR driver.");
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+    proc_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(proc_window), "Top power consumers");
+    gtk_window_set_transient_for(GTK_WINDOW(proc_window), GTK_WINDOW(window));
+    gtk_window_set_default_size(GTK_WINDOW(proc_window), 400, defaultHeight);
+    g_signal_connect(proc_window, "destroy", G_CALLBACK(proc_window_destroyed), NULL);
+
+    proc_store = gtk_list_store_new(PROC_NUM_COLUMNS, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING);
+    treeview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(proc_store));
+    g_object_unref(proc_store);
+
+    renderer = gtk_cell_renderer_text_new();
+    column = gtk_tree_view_column_new_with_attributes("PID", renderer, "text", PROC_COLUMN_PID, NULL);
+    g_object_set(renderer, "family", "monotype", NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(treeview), column);
+
+    renderer = gtk_cell_renderer_text_new();
+    column = gtk_tree_view_column_new_with_attributes("Process", renderer, "text", PROC_COLUMN_NAME, NULL);
+    g_object_set(renderer, "family", "monotype", NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(treeview), column);
+
+    renderer = gtk_cell_renderer_text_new();
+    column = gtk_tree_view_column_new_with_attributes("Power", renderer, "text", PROC_COLUMN_POWER, NULL);
+    g_object_set(renderer, "family", "monotype", NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(treeview), column);
+
+    sw = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW (sw), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(sw), treeview);
+    gtk_container_add(GTK_CONTAINER(proc_window), sw);
+
+    // Baseline for the first interval
+    procpower_set_active(TRUE);
+    procpower_update();
+    gtk_widget_show_all(proc_window);
+}
+
+// Cores top to bottom, frequency bins left to right, brighter = more time.
+// Only the range of bins that saw any time is drawn.
+static gboolean hist_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    const gint left = 70, bottom = 22, top = 8, right = 8;
+    gint width = gtk_widget_get_allocated_width(widget);
+    gint height = gtk_widget_get_allocated_height(widget);
+    guint c, b, lo = G_MAXUINT, hi = 0;
+    gdouble cell_w, cell_h, share;
+    gchar text[32];
+
+    cairo_set_source_rgb(cr, 0.12, 0.12, 0.12);
+    cairo_paint(cr);
+
+    for (c = 0; c < freq_hist->cores; c++) {
+        for (b = 0; b < freq_hist->bins; b++) {
+            if (freq_hist->time[(gsize)c * freq_hist->bins + b]) {
+                lo = MIN(lo, b);
+                hi = MAX(hi, b);
+            }
+        }
+    }
+    if (lo > hi)
+        return TRUE;
+
+    cell_w = (gdouble)(width - left - right) / (hi - lo + 1);
+    cell_h = (gdouble)(height - top - bottom) / freq_hist->cores;
+
+    for (c = 0; c < freq_hist->cores; c++) {
+        if (freq_hist->total[c] == 0)
+            continue;
+
+        for (b = lo; b <= hi; b++) {
+            share = (gdouble)freq_hist->time[(gsize)c * freq_hist->bins + b] / freq_hist->total[c];
+            if (share == 0)
+                continue;
+
+            // Square root keeps short visits to a bin visible
+            share = sqrt(share);
+            cairo_set_source_rgb(cr, MIN(1.0, share * 2), MAX(0.0, share * 2 - 1), 0.15 * (1 - share));
+            cairo_rectangle(cr, left + (b - lo) * cell_w, top + c * cell_h, ceil(cell_w), ceil(cell_h));
+            cairo_fill(cr);
+        }
+    }
+
+    cairo_set_source_rgb(cr, 0.85, 0.85, 0.85);
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 11);
+
+    for (c = 0; c < freq_hist->cores; c++) {
+        if (cell_h < 12 && c % (guint)ceil(12 / cell_h))
+            continue;
+        g_snprintf(text, sizeof text, "Core %d", freq_hist->sensors[c]->core);
+        cairo_move_to(cr, 4, top + c * cell_h + cell_h / 2 + 4);
+        cairo_show_text(cr, text);
+    }
+
+    // A tick on every full GHz
+    for (b = lo; b <= hi + 1; b++) {
+        if ((b * freq_hist->bin_mhz) % 1000 >= freq_hist->bin_mhz)
             continue;
+        g_snprintf(text, sizeof text, "%u GHz", b * freq_hist->bin_mhz / 1000);
+        cairo_move_to(cr, left + (b - lo) * cell_w, height - 6);
+        cairo_show_text(cr, text);
+    }
 
-        source->func_clear_minmax();
+    return TRUE;
+}
+
+static void hist_reset_clicked(GtkButton *button, gpointer user_data) {
+    freqhist_reset(freq_hist);
+    gtk_widget_queue_draw(hist_area);
+}
+
+static void hist_window_destroyed(GtkWidget *widget, gpointer user_data) {
+    freqhist_free(freq_hist);
+    freq_hist = NULL;
+    hist_area = NULL;
+}
+
+static void hist_btn_clicked(GtkButton *button, gpointer user_data) {
+    GtkWidget *hist_window;
+    GtkWidget *header;
+    GtkWidget *reset_btn;
+    GtkWidget *dialog;
+
+    if (freq_hist)
+        return;
+
+    freq_hist = freqhist_new(sensor_sources, hist_bin_mhz);
+    if (!freq_hist) {
+        dialog = gtk_message_dialog_new(GTK_WINDOW (window),
+                                        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                        GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                        "Frequency residency needs per-core frequency sensors.");
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        return;
     }
+
+    hist_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_transient_for(GTK_WINDOW(hist_window), GTK_WINDOW(window));
+    gtk_window_set_default_size(GTK_WINDOW(hist_window), 600, MAX(defaultHeight, freq_hist->cores * 14 + 40));
+    g_signal_connect(hist_window, "destroy", G_CALLBACK(hist_window_destroyed), NULL);
+
+    header = gtk_header_bar_new();
+    gtk_header_bar_set_show_close_button(GTK_HEADER_BAR(header), TRUE);
+    gtk_header_bar_set_title(GTK_HEADER_BAR(header), "Frequency residency");
+    gtk_window_set_titlebar(GTK_WINDOW(hist_window), header);
+
+    reset_btn = gtk_button_new();
+    gtk_container_add(GTK_CONTAINER(reset_btn), gtk_image_new_from_icon_name("edit-clear-all", GTK_ICON_SIZE_BUTTON));
+    gtk_widget_set_tooltip_text(reset_btn, "Reset");
+    gtk_header_bar_pack_start(GTK_HEADER_BAR(header), reset_btn);
+    g_signal_connect(reset_btn, "clicked", G_CALLBACK(hist_reset_clicked), NULL);
+
+    hist_area = gtk_drawing_area_new();
+    g_signal_connect(hist_area, "draw", G_CALLBACK(hist_draw), NULL);
+    gtk_container_add(GTK_CONTAINER(hist_window), hist_area);
+
+    gtk_widget_show_all(hist_window);
+}
+
+// All sensors of the metric take part in the ranking, so all are read
+static void select_top_metric(TopMetric *m) {
+    guint i;
+
+    for (i = 0; top_metric && i < top_metric->sensors->len; i++)
+        sensor_unobserve(g_ptr_array_index(top_metric->sensors, i));
+
+    top_metric = m;
+    g_ptr_array_set_size(top_ranking, 0);
+    clear_top_rows();
+
+    for (i = 0; top_metric && i < top_metric->sensors->len; i++) {
+        sensor_observe(g_ptr_array_index(top_metric->sensors, i));
+        g_ptr_array_add(top_ranking, g_ptr_array_index(top_metric->sensors, i));
+    }
+
+    if (top_metric)
+        update_top();
+}
+
+static void top_metric_changed(GtkComboBox *combo, gpointer user_data) {
+    gint active = gtk_combo_box_get_active(combo);
+
+    select_top_metric(active >= 0 ? g_ptr_array_index(top_metrics, active) : NULL);
+}
+
+static void top_order_changed(GtkComboBox *combo, gpointer user_data) {
+    top_order = MAX(gtk_combo_box_get_active(combo), 0);
+    if (top_metric)
+        update_top();
+}
+
+static void top_count_changed(GtkSpinButton *spin, gpointer user_data) {
+    top_count = gtk_spin_button_get_value_as_int(spin);
+    if (top_metric)
+        update_top();
+}
+
+static void top_window_destroyed(GtkWidget *widget, gpointer user_data) {
+    TopMetric *m;
+    guint i;
+
+    select_top_metric(NULL);
+    top_store = NULL;
+
+    for (i = 0; i < top_metrics->len; i++) {
+        m = g_ptr_array_index(top_metrics, i);
+        g_ptr_array_free(m->sensors, TRUE);
+        g_free(m->key);
+        g_free(m);
+    }
+    g_ptr_array_free(top_metrics, TRUE);
+    g_ptr_array_free(top_ranking, TRUE);
+    g_ptr_array_free(top_shown, TRUE);
+    g_hash_table_destroy(top_rows);
+    top_metrics = NULL;
+}
+
+static void top_btn_clicked(GtkButton *button, gpointer user_data) {
+    GtkWidget *top_window;
+    GtkWidget *header;
+    GtkWidget *metric_combo;
+    GtkWidget *order_combo;
+    GtkWidget *count_spin;
+    GtkWidget *treeview;
+    GtkWidget *sw;
+    GtkCellRenderer *renderer;
+    GtkTreeViewColumn *column;
+    const gchar *titles[] = { "#", "Sensor", "Value", "Min", "Max" };
+    guint i;
+
+    if (top_store)
+        return;
+
+    build_top_metrics();
+    top_ranking = g_ptr_array_new();
+    top_shown = g_ptr_array_new();
+    top_rows = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    top_window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_transient_for(GTK_WINDOW(top_window), GTK_WINDOW(window));
+    gtk_window_set_default_size(GTK_WINDOW(top_window), 500, defaultHeight);
+    g_signal_connect(top_window, "destroy", G_CALLBACK(top_window_destroyed), NULL);
+
+    header = gtk_header_bar_new();
+    gtk_header_bar_set_show_close_button(GTK_HEADER_BAR(header), TRUE);
+    gtk_header_bar_set_title(GTK_HEADER_BAR(header), "Top sensors");
+    gtk_window_set_titlebar(GTK_WINDOW(top_window), header);
+
+    metric_combo = gtk_combo_box_text_new();
+    for (i = 0; i < top_metrics->len; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(metric_combo), ((TopMetric*)g_ptr_array_index(top_metrics, i))->key);
+    gtk_header_bar_pack_start(GTK_HEADER_BAR(header), metric_combo);
+
+    order_combo = gtk_combo_box_text_new();
+    for (i = 0; top_orders[i]; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(order_combo), top_orders[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(order_combo), top_order);
+    gtk_header_bar_pack_start(GTK_HEADER_BAR(header), order_combo);
+
+    count_spin = gtk_spin_button_new_with_range(1, 1000, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(count_spin), top_count);
+    gtk_widget_set_tooltip_text(count_spin, "Rows shown");
+    gtk_header_bar_pack_end(GTK_HEADER_BAR(header), count_spin);
+
+    top_store = gtk_list_store_new(TOP_NUM_COLUMNS, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING,
+                                   G_TYPE_STRING, G_TYPE_STRING);
+    treeview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(top_store));
+    g_object_unref(top_store);
+
+    for (i = 0; i < TOP_NUM_COLUMNS; i++) {
+        renderer = gtk_cell_renderer_text_new();
+        column = gtk_tree_view_column_new_with_attributes(titles[i], renderer, "text", i, NULL);
+        g_object_set(renderer, "family", "monotype", NULL);
+        gtk_tree_view_append_column(GTK_TREE_VIEW(treeview), column);
+    }
+
+    sw = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW (sw), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(sw), treeview);
+    gtk_container_add(GTK_CONTAINER(top_window), sw);
+
+    g_signal_connect(metric_combo, "changed", G_CALLBACK(top_metric_changed), NULL);
+    g_signal_connect(order_combo, "changed", G_CALLBACK(top_order_changed), NULL);
+    g_signal_connect(count_spin, "value-changed", G_CALLBACK(top_count_changed), NULL);
+    if (top_metrics->len > 0)
+        gtk_combo_box_set_active(GTK_COMBO_BOX(metric_combo), 0);
+
+    gtk_widget_show_all(top_window);
 }
 
 static gboolean mid_search_eq_func(GtkTreeModel *model, gint column, const gchar *key, GtkTreeIter *iter) {
-    gchar *iter_string = NULL, *lc_iter_string = NULL, *lc_key = NULL;
+    gchar *iter_string = NULL;
     gboolean result;
 
     gtk_tree_model_get(model, iter, column, &iter_string, -1);
-    lc_iter_string = g_utf8_strdown(iter_string, -1);
-    lc_key = g_utf8_strdown(key, -1);
-
-    result = (g_strrstr(lc_iter_string, lc_key) == NULL);
-
+    result = !sensor_label_matches(iter_string, key);
     g_free(iter_string);
-    g_free(lc_iter_string);
-    g_free(lc_key);
 
     return result;
 }
 
+static gint count_visible_rows(GtkTreeView *treeview, GtkTreeModel *model, GtkTreeIter *parent) {
+    GtkTreeIter iter;
+    GtkTreePath *path;
+    gboolean valid;
+    gint rows = 0;
+
+    valid = gtk_tree_model_iter_children(model, &iter, parent);
+    while (valid) {
+        rows++;
+        if (gtk_tree_model_iter_has_child(model, &iter)) {
+            path = gtk_tree_model_get_path(model, &iter);
+            if (gtk_tree_view_row_expanded(treeview, path))
+                rows += count_visible_rows(treeview, model, &iter);
+            gtk_tree_path_free(path);
+        }
+        valid = gtk_tree_model_iter_next(model, &iter);
+    }
+
+    return rows;
+}
+
 static void resize_to_treeview(GtkWindow* window, GtkTreeView* treeview) {
     gint uiHeight, cellHeight, vSeparator, rows;
     GdkRectangle r;
@@ -196,7 +1209,7 @@ static void resize_to_treeview(GtkWindow* window, GtkTreeView* treeview) {
 
     gtk_tree_view_column_cell_get_size(col, NULL, NULL, NULL, NULL, &cellHeight);
     gtk_widget_style_get(GTK_WIDGET(treeview), "vertical-separator", &vSeparator, NULL);
-    rows = gtk_tree_model_iter_n_children(gtk_tree_view_get_model(treeview), NULL);
+    rows = count_visible_rows(treeview, gtk_tree_view_get_model(treeview), NULL);
 
     gtk_tree_view_get_visible_rect(treeview, &r);
     uiHeight = defaultHeight - r.height;
@@ -204,15 +1217,118 @@ static void resize_to_treeview(GtkWindow* window, GtkTreeView* treeview) {
     gtk_window_resize(window, 500, uiHeight + (vSeparator + cellHeight) * rows);
 }
 
+// Small sources are opened completely, large ones down to the CCX rows.
+// Groups and rows from first_group/first_row on belong to root.
+static void expand_source(GtkTreeView *treeview, GuiGroup *root, guint first_group, guint first_row) {
+    GtkTreePath *path;
+    GuiGroup *g;
+    guint i;
+
+    if (groups->len - first_group + rows->len - first_row <= GUI_EXPAND_ALL_ROWS) {
+        path = gtk_tree_model_get_path(model, &root->iter);
+        gtk_tree_view_expand_row(treeview, path, TRUE);
+        gtk_tree_path_free(path);
+        return;
+    }
+
+    for (i = first_group; i < groups->len; i++) {
+        g = g_ptr_array_index(groups, i);
+        if (g->kind != GROUP_SOURCE && g->kind != GROUP_NODE)
+            continue;
+
+        path = gtk_tree_model_get_path(model, &g->iter);
+        gtk_tree_view_expand_row(treeview, path, FALSE);
+        gtk_tree_path_free(path);
+    }
+}
+
+static void add_source(SensorSource *source) {
+    SensorSource *other;
+    guint index = source - sensor_sources, first_group, first_row;
+    GuiGroup *root;
+
+    if (source->enabled) {
+        first_group = groups->len;
+        first_row = rows->len;
+        root = roots[index] = init_source_rows(source);
+
+        // Keep the table order whichever source finishes first
+        for (other = source + 1; other->drv; other++) {
+            if (roots[other - sensor_sources]) {
+                gtk_tree_store_move_before(GTK_TREE_STORE(model), &root->iter, &roots[other - sensor_sources]->iter);
+                break;
+            }
+        }
+
+        expand_source(sensor_view, root, first_group, first_row);
+        interest_dirty = TRUE;
+    }
+    ready[index] = TRUE;
+}
+
+static gboolean source_finished(gpointer data) {
+    SensorSource *source;
+
+    add_source(data);
+
+    if (--pending == 0) {
+        // Derived sources read the others' sensors, they are quick to set up
+        for (source = sensor_sources; source->drv; source++) {
+            if (source->derived) {
+                sensor_source_init(source);
+                add_source(source);
+            }
+        }
+
+        alerts_bind(sensor_sources);
+        gtk_widget_set_sensitive(hist_btn, TRUE);
+        gtk_widget_set_sensitive(top_btn, TRUE);
+        resize_to_treeview(GTK_WINDOW(window), sensor_view);
+        manifest_save();
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer source_thread(gpointer data) {
+    sensor_source_init(data);
+    g_idle_add(source_finished, data);
+    return NULL;
+}
+
+static void init_sensors() {
+    SensorSource *source;
+    guint count = 0;
+
+    groups = g_ptr_array_new();
+    rows = g_array_new(FALSE, FALSE, sizeof(GuiRow));
+
+    for (source = sensor_sources; source->drv; source++) {
+        count++;
+        if (!source->derived)
+            pending++;
+    }
+
+    ready = g_new0(gboolean, count);
+    roots = g_new0(GuiGroup*, count);
+
+    for (source = sensor_sources; source->drv; source++) {
+        if (!source->derived)
+            g_thread_unref(g_thread_new(source->drv, source_thread, source));
+    }
+}
+
 int start_gui (SensorSource *ss) {
     GtkWidget *about_btn;
     GtkWidget *clear_btn;
+    GtkWidget *proc_btn;
     GtkWidget *box;
     GtkWidget *header;
     GtkWidget *treeview;
     GtkWidget *sw;
     GtkWidget *vbox;
     GtkWidget *dialog;
+    GtkAdjustment *vadjustment;
 
     window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_position(GTK_WINDOW(window), GTK_WIN_POS_CENTER);
@@ -238,9 +1354,29 @@ int start_gui (SensorSource *ss) {
     gtk_container_add(GTK_CONTAINER(box), clear_btn);
     gtk_widget_set_tooltip_text(clear_btn, "Clear Min/Max");
 
+    proc_btn = gtk_button_new();
+    gtk_container_add(GTK_CONTAINER(proc_btn), gtk_image_new_from_icon_name("utilities-system-monitor", GTK_ICON_SIZE_BUTTON));
+    gtk_container_add(GTK_CONTAINER(box), proc_btn);
+    gtk_widget_set_tooltip_text(proc_btn, "Top power consumers");
+
+    hist_btn = gtk_button_new();
+    gtk_container_add(GTK_CONTAINER(hist_btn), gtk_image_new_from_icon_name("view-grid-symbolic", GTK_ICON_SIZE_BUTTON));
+    gtk_container_add(GTK_CONTAINER(box), hist_btn);
+    gtk_widget_set_tooltip_text(hist_btn, "Frequency residency");
+    gtk_widget_set_sensitive(hist_btn, FALSE);
+
+    top_btn = gtk_button_new();
+    gtk_container_add(GTK_CONTAINER(top_btn), gtk_image_new_from_icon_name("view-sort-descending-symbolic", GTK_ICON_SIZE_BUTTON));
+    gtk_container_add(GTK_CONTAINER(box), top_btn);
+    gtk_widget_set_tooltip_text(top_btn, "Top sensors");
+    gtk_widget_set_sensitive(top_btn, FALSE);
+
     gtk_header_bar_pack_start(GTK_HEADER_BAR(header), box);
     g_signal_connect(about_btn, "clicked", G_CALLBACK(about_btn_clicked), NULL);
     g_signal_connect(clear_btn, "clicked", G_CALLBACK(clear_btn_clicked), NULL);
+    g_signal_connect(proc_btn, "clicked", G_CALLBACK(proc_btn_clicked), NULL);
+    g_signal_connect(hist_btn, "clicked", G_CALLBACK(hist_btn_clicked), NULL);
+    g_signal_connect(top_btn, "clicked", G_CALLBACK(top_btn_clicked), NULL);
     g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
 
     vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
@@ -253,7 +1389,13 @@ int start_gui (SensorSource *ss) {
 
     model = create_model();
     treeview = gtk_tree_view_new_with_model(model);
+    sensor_view = GTK_TREE_VIEW(treeview);
     gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(treeview), COLUMN_HINT);
+    g_signal_connect(treeview, "row-expanded", G_CALLBACK(row_expanded), NULL);
+    g_signal_connect(treeview, "row-collapsed", G_CALLBACK(row_collapsed), NULL);
+    vadjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(sw));
+    g_signal_connect(vadjustment, "value-changed", G_CALLBACK(view_scrolled), NULL);
+    g_signal_connect(vadjustment, "changed", G_CALLBACK(view_scrolled), NULL);
 
     gtk_container_add (GTK_CONTAINER(sw), treeview);
     add_columns(GTK_TREE_VIEW(treeview));
@@ -268,8 +1410,6 @@ int start_gui (SensorSource *ss) {
     if (check_zen()){
         sensor_sources = ss;
         init_sensors();
-
-        resize_to_treeview(GTK_WINDOW(window), GTK_TREE_VIEW(treeview));
         timeout = g_timeout_add(300, update_data, NULL);
     }
     else{
@@ -0,0 +1,4 @@
+gboolean alerts_load(const gchar *filename);
+void alerts_bind(SensorSource *sources);
+gboolean alerts_active();
+void alerts_evaluate();
@@ -0,0 +1 @@
+gboolean burst_capture(gint seconds, guint rate, gint cpu, const gchar *filename);
@@ -0,0 +1,4 @@
+gboolean derived_init();
+GSList* derived_get_sensors();
+void derived_update();
+void derived_clear_minmax();
@@ -0,0 +1,17 @@
+#define FREQHIST_MAX_MHZ 6400
+
+// Time each core spent in each frequency bin, fixed size once created
+typedef struct FreqHist {
+    guint cores;
+    guint bins;
+    guint bin_mhz;
+    SensorInit **sensors;       // cores, effective frequency in GHz
+    guint64 *time;              // cores * bins, us spent in each bin
+    guint64 *total;             // cores, us accounted per core
+    gint64 last_update;
+} FreqHist;
+
+FreqHist *freqhist_new(SensorSource *sources, guint bin_mhz);
+void freqhist_update(FreqHist *h);
+void freqhist_reset(FreqHist *h);
+void freqhist_free(FreqHist *h);
@@ -0,0 +1,5 @@
+gboolean hwmon_init();
+GSList* hwmon_get_sensors();
+void hwmon_update();
+void hwmon_clear_minmax();
+SensorInit* hwmon_core_power_sensor(gint node);
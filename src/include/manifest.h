@@ -0,0 +1,7 @@
+gchar** manifest_get_list(const gchar *group, const gchar *key, gsize *length);
+void manifest_set_list(const gchar *group, const gchar *key, const gchar * const *list, gsize length);
+gboolean manifest_get_boolean(const gchar *group, const gchar *key, gboolean *value);
+void manifest_set_boolean(const gchar *group, const gchar *key, gboolean value);
+gboolean manifest_get_integer(const gchar *group, const gchar *key, gint *value);
+void manifest_set_integer(const gchar *group, const gchar *key, gint value);
+void manifest_save();
@@ -1,4 +1,16 @@
+extern gfloat *core_power;
+
 gboolean msr_init();
 void msr_update();
 void msr_clear_minmax();
 GSList* msr_get_sensors();
+void msr_observe_core_power(gboolean observe);
+guint msr_node_count();
+SensorInit* msr_package_sensor(guint node);
+GPtrArray* msr_core_power_sensors(guint node);
+gboolean msr_bench(guint ticks);
+gdouble get_energy_unit();
+gulong get_core_energy(gint core);
+gdouble get_core_fid(gint core);
+gulong get_core_aperf(gint core);
+gulong get_core_mperf(gint core);
@@ -0,0 +1,5 @@
+void plugins_set_files(gchar **files);
+gboolean plugins_init();
+GSList* plugins_get_sensors();
+void plugins_update();
+void plugins_clear_minmax();
@@ -0,0 +1,13 @@
+#define PROCPOWER_COMM_LEN 17
+#define PROCPOWER_TOP 20
+
+typedef struct ProcPower {
+    gint pid;
+    gfloat power;
+    gchar comm[PROCPOWER_COMM_LEN];
+} ProcPower;
+
+gboolean procpower_init(void);
+void procpower_set_active(gboolean active);
+void procpower_update(void);
+guint procpower_top(ProcPower *top, guint n);
@@ -0,0 +1 @@
+gboolean record_run(SensorSource *sources, const gchar *filename, guint interval_ms, gboolean proc_power);
@@ -0,0 +1,57 @@
+// Wire protocol between "zenmonitor --server" and its clients.
+//
+// The socket is a SOCK_SEQPACKET Unix socket, so every message arrives whole.
+// All values are in host byte order; both ends always run on the same machine.
+//
+// Server -> client, once after connect:
+//   RemoteHello, then for each sensor four strings (source, label, hint,
+//   printf format), each a guint16 length followed by the bytes, and a
+//   RemoteTopology.
+// Server -> client, every tick:
+//   RemoteFrame, then sensor_count RemoteValue. Min/Max cover everything since
+//   the server started; clients that clear them track their own from then on.
+// Client -> server:
+//   nothing, anything a client sends is discarded.
+
+#define REMOTE_DEFAULT_SOCKET "/run/zenmonitor.sock"
+#define REMOTE_MAGIC 0x50534D5A     // "ZMSP"
+#define REMOTE_VERSION 3
+#define REMOTE_MSG_HELLO 1
+#define REMOTE_MSG_FRAME 2
+
+typedef struct {
+    guint32 magic;
+    guint16 version;
+    guint16 type;
+    guint32 sensor_count;
+    guint32 interval_ms;
+} RemoteHello;
+
+typedef struct {
+    gint16 node;
+    gint16 ccx;
+    gint16 core;
+    guint16 aggregate;
+} RemoteTopology;
+
+typedef struct {
+    guint32 magic;
+    guint16 version;
+    guint16 type;
+    guint32 seq;
+    guint32 sensor_count;
+    gint64 timestamp;           // us, CLOCK_MONOTONIC of the server
+} RemoteFrame;
+
+typedef struct {
+    gfloat value;
+    gfloat min;
+    gfloat max;
+    guint32 stale;              // min/max missed samples on the server
+} RemoteValue;
+
+void remote_set_socket(const gchar *path);
+gboolean remote_init();
+GSList* remote_get_sensors();
+void remote_update();
+void remote_clear_minmax();
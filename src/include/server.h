@@ -0,0 +1 @@
+gboolean server_run(SensorSource *sources, const gchar *path, guint interval_ms, const gchar *user);
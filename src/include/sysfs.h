@@ -3,6 +3,11 @@
 struct cpudev {
 	gshort coreid;
 	gshort cpuid;
+	gshort node;    // physical package
+	gshort ccx;     // L3 cache domain, numbered from 0 across the system
 };
 
+// Shared, do not free
 struct cpudev * get_cpu_dev_ids(void);
+gint * get_cpu_core_map(guint *ncpus);
+gshort get_numa_node_package(gint numa);
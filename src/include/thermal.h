@@ -0,0 +1,4 @@
+gboolean thermal_init();
+GSList* thermal_get_sensors();
+void thermal_update();
+void thermal_clear_minmax();
@@ -0,0 +1 @@
+int start_tui(SensorSource *ss);
@@ -0,0 +1 @@
+int start_viewer(const gchar *filename);
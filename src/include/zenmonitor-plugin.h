@@ -0,0 +1,57 @@
+// Sensor source plugin ABI.
+//
+// A plugin is a shared object exporting
+//
+//   const ZmPlugin* zenmonitor_plugin(void);
+//
+// It is loaded from the plugin directory or with --plugin=FILE. init()
+// declares the sensors once; after that update() is called every tick with
+// a slice of the host's frame and writes all values in one go, in the order
+// the sensors were declared. Plugins do not depend on glib or GTK.
+//
+// Only ZM_PLUGIN_ABI_VERSION changes when this file changes incompatibly;
+// plugins built for another version are refused.
+
+#ifndef ZENMONITOR_PLUGIN_H
+#define ZENMONITOR_PLUGIN_H
+
+#define ZM_PLUGIN_ABI_VERSION 1
+#define ZM_PLUGIN_ENTRY "zenmonitor_plugin"
+
+// How group rows summarise the sensor, see SensorAggregate
+enum {
+    ZM_PLUGIN_AGG_NONE = 0,
+    ZM_PLUGIN_AGG_SUM,
+    ZM_PLUGIN_AGG_AVG,
+    ZM_PLUGIN_AGG_MAX
+};
+
+typedef struct {
+    const char *label;
+    const char *hint;               // tooltip, may be NULL
+    const char *printf_format;      // one float, e.g. " %6.2f°C"
+    int node;                       // topology for grouping, -1 if none
+    int ccx;
+    int core;
+    int aggregate;                  // ZM_PLUGIN_AGG_*
+} ZmPluginSensor;
+
+typedef struct {
+    unsigned int abi_version;       // ZM_PLUGIN_ABI_VERSION
+    const char *name;
+
+    // Stores the sensor table in *sensors (owned by the plugin, kept until
+    // shutdown) and returns its length; 0 or less disables the plugin.
+    int (*init)(const ZmPluginSensor **sensors);
+
+    // Writes count values. wanted[i] is zero when nobody looks at sensor i,
+    // the plugin may leave values[i] untouched then. NaN marks a failed read.
+    void (*update)(float *values, const unsigned char *wanted, unsigned int count);
+
+    // May be NULL
+    void (*shutdown)(void);
+} ZmPlugin;
+
+typedef const ZmPlugin* (*ZmPluginEntry)(void);
+
+#endif
@@ -1,6 +1,14 @@
 #define ERROR_VALUE -999.0
 #define VERSION "1.4.2"
 
+// How a group row summarises the sensors below it
+typedef enum {
+    SENSOR_AGG_NONE = 0,
+    SENSOR_AGG_SUM,
+    SENSOR_AGG_AVG,
+    SENSOR_AGG_MAX
+} SensorAggregate;
+
 typedef struct
 {
     gchar *label;
@@ -9,6 +17,17 @@ typedef struct
     float *min;
     float *max;
     const gchar *printf_format;
+    // Topology used to group rows, -1 when it does not apply
+    gint node;
+    gint ccx;
+    gint core;
+    SensorAggregate aggregate;
+    // Number of consumers currently showing or exporting the value
+    gint observers;
+    // Updates were skipped since the last min/max reset
+    gboolean stale;
+    // Sensors the value is computed from, observed along with it
+    GSList *deps;
 }
 SensorInit;
 
@@ -20,11 +39,27 @@ typedef struct {
     void (*func_clear_minmax)();
     gboolean enabled;
     GSList *sensors;
+    // Computed from the other sources' sensors, initialised after all of them
+    gboolean derived;
 } SensorSource;
 
 SensorInit* sensor_init_new(void);
 void sensor_init_free(SensorInit *s);
+gboolean sensor_source_init(SensorSource *source);
+guint sensor_sources_init(SensorSource *sources);
+GSList* sensor_source_sensors(const gchar *drv);
+void sensor_source_clear_minmax(SensorSource *source);
+void sensor_source_observe_all(SensorSource *source);
+void sensor_observe(SensorInit *s);
+void sensor_unobserve(SensorInit *s);
+gboolean sensor_needed(SensorInit *s);
+gboolean sensor_label_matches(const gchar *label, const gchar *key);
+gboolean sensor_format_is_safe(const gchar *fmt);
+void sensor_track(gfloat value, gfloat *current, gfloat *min, gfloat *max);
+gfloat sensors_sum(GPtrArray *sensors);
 gboolean check_zen();
 gchar *cpu_model();
 guint get_core_count();
 extern gboolean display_coreid;
+extern gint hist_bin_mhz;
+extern gint thermal_limit;
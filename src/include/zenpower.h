@@ -1,4 +0,0 @@
-gboolean zenpower_init();
-GSList* zenpower_get_sensors();
-void zenpower_update();
-void zenpower_clear_minmax();
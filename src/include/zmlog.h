@@ -0,0 +1,47 @@
+#define ZMLOG_MAGIC "ZMLOG\0"
+#define ZMLOG_VERSION 1
+#define ZMLOG_CHUNK_ROWS 600
+#define ZMLOG_MAX_CHUNK_ROWS 65536     // what a reader accepts
+#define ZMLOG_TAG_DATA "DATA"
+#define ZMLOG_TAG_PROC "PROC"
+#define ZMLOG_TAG_HIST "HIST"
+
+typedef struct ZmLogWriter ZmLogWriter;
+struct ProcPower;
+struct FreqHist;
+
+ZmLogWriter *zmlog_writer_new(const gchar *filename, SensorSource *sources, guint interval_us);
+gboolean zmlog_writer_append(ZmLogWriter *w);
+void zmlog_writer_append_procs(ZmLogWriter *w, const struct ProcPower *top, guint n);
+void zmlog_writer_append_hist(ZmLogWriter *w, const struct FreqHist *h);
+gboolean zmlog_writer_close(ZmLogWriter *w);
+
+typedef struct {
+    gchar *source;
+    gchar *label;
+    gchar *hint;
+    gchar *printf_format;
+} ZmLogSensor;
+
+typedef struct {
+    guint rows;
+    guint64 first_row;
+    const guint8 *columns;
+    guint32 *col_offset;        // n_sensors + 1
+} ZmLogChunk;
+
+typedef struct {
+    GMappedFile *map;
+    gint64 start_time;
+    guint interval;
+    guint n_sensors;
+    guint chunk_rows;
+    ZmLogSensor *sensors;
+    GArray *chunks;             // ZmLogChunk
+    GArray *time;               // gint64 per row, us since start_time
+    guint64 rows;
+} ZmLogReader;
+
+ZmLogReader *zmlog_reader_open(const gchar *filename);
+gboolean zmlog_reader_column(ZmLogReader *r, guint chunk, guint sensor, gfloat *values);
+void zmlog_reader_close(ZmLogReader *r);
@@ -0,0 +1,162 @@
+#include <glib.h>
+#include <cpuid.h>
+#include <string.h>
+#include <sys/utsname.h>
+#include "zenmonitor.h"
+#include "manifest.h"
+
+// Discovery manifest
+//
+// Sources store what they found at startup (topology, hwmon attributes,
+// MSR availability) in $XDG_CACHE_HOME/zenmonitor/manifest and reuse it on
+// the next start instead of walking sysfs again. The manifest is only valid
+// for the kernel, CPU and boot it was written on; any difference and it is
+// thrown away and rebuilt.
+//
+// Sources initialise in parallel threads, every access takes the lock.
+
+#define MANIFEST_GROUP_KEY "manifest"
+
+static GMutex lock;
+static GKeyFile *manifest = NULL;
+static gboolean dirty = FALSE;
+
+static gchar* manifest_path() {
+    return g_build_filename(g_get_user_cache_dir(), "zenmonitor", "manifest", NULL);
+}
+
+static void manifest_key(gchar **kernel, gchar **cpu, gchar **boot) {
+    guint32 eax = 0, ebx = 0, ecx = 0, edx = 0;
+    struct utsname uts;
+    gchar *model;
+
+    *kernel = g_strdup(uname(&uts) == 0 ? uts.release : "");
+
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    model = cpu_model();
+    *cpu = g_strdup_printf("%08x %s", eax, model);
+    g_free(model);
+
+    if (!g_file_get_contents("/proc/sys/kernel/random/boot_id", boot, NULL, NULL))
+        *boot = g_strdup("");
+    g_strchomp(*boot);
+}
+
+static gboolean key_matches(GKeyFile *kf, const gchar *key, const gchar *expected) {
+    gchar *value = g_key_file_get_string(kf, MANIFEST_GROUP_KEY, key, NULL);
+    gboolean result = g_strcmp0(value, expected) == 0;
+
+    g_free(value);
+    return result;
+}
+
+// Called with the lock held
+static void manifest_open() {
+    gchar *path, *kernel, *cpu, *boot;
+
+    if (manifest)
+        return;
+
+    manifest_key(&kernel, &cpu, &boot);
+    manifest = g_key_file_new();
+
+    path = manifest_path();
+    if (!g_key_file_load_from_file(manifest, path, G_KEY_FILE_NONE, NULL) ||
+        !key_matches(manifest, "kernel", kernel) ||
+        !key_matches(manifest, "cpu", cpu) ||
+        !key_matches(manifest, "boot", boot)) {
+
+        g_key_file_free(manifest);
+        manifest = g_key_file_new();
+        g_key_file_set_string(manifest, MANIFEST_GROUP_KEY, "kernel", kernel);
+        g_key_file_set_string(manifest, MANIFEST_GROUP_KEY, "cpu", cpu);
+        g_key_file_set_string(manifest, MANIFEST_GROUP_KEY, "boot", boot);
+        dirty = TRUE;
+    }
+
+    g_free(path);
+    g_free(kernel);
+    g_free(cpu);
+    g_free(boot);
+}
+
+gchar** manifest_get_list(const gchar *group, const gchar *key, gsize *length) {
+    gchar **list;
+
+    g_mutex_lock(&lock);
+    manifest_open();
+    list = g_key_file_get_string_list(manifest, group, key, length, NULL);
+    g_mutex_unlock(&lock);
+
+    return list;
+}
+
+void manifest_set_list(const gchar *group, const gchar *key, const gchar * const *list, gsize length) {
+    g_mutex_lock(&lock);
+    manifest_open();
+    g_key_file_set_string_list(manifest, group, key, list, length);
+    dirty = TRUE;
+    g_mutex_unlock(&lock);
+}
+
+gboolean manifest_get_boolean(const gchar *group, const gchar *key, gboolean *value) {
+    GError *error = NULL;
+
+    g_mutex_lock(&lock);
+    manifest_open();
+    *value = g_key_file_get_boolean(manifest, group, key, &error);
+    g_mutex_unlock(&lock);
+
+    if (error) {
+        g_error_free(error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void manifest_set_boolean(const gchar *group, const gchar *key, gboolean value) {
+    g_mutex_lock(&lock);
+    manifest_open();
+    g_key_file_set_boolean(manifest, group, key, value);
+    dirty = TRUE;
+    g_mutex_unlock(&lock);
+}
+
+gboolean manifest_get_integer(const gchar *group, const gchar *key, gint *value) {
+    GError *error = NULL;
+
+    g_mutex_lock(&lock);
+    manifest_open();
+    *value = g_key_file_get_integer(manifest, group, key, &error);
+    g_mutex_unlock(&lock);
+
+    if (error) {
+        g_error_free(error);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void manifest_set_integer(const gchar *group, const gchar *key, gint value) {
+    g_mutex_lock(&lock);
+    manifest_open();
+    g_key_file_set_integer(manifest, group, key, value);
+    dirty = TRUE;
+    g_mutex_unlock(&lock);
+}
+
+// Best effort, a manifest that cannot be written just means a slower start
+void manifest_save() {
+    gchar *path, *dir;
+
+    g_mutex_lock(&lock);
+    if (manifest && dirty) {
+        path = manifest_path();
+        dir = g_path_get_dirname(path);
+        if (g_mkdir_with_parents(dir, 0755) == 0 && g_key_file_save_to_file(manifest, path, NULL))
+            dirty = FALSE;
+        g_free(dir);
+        g_free(path);
+    }
+    g_mutex_unlock(&lock);
+}
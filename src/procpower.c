@@ -0,0 +1,402 @@
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "zenmonitor.h"
+#include "msr.h"
+#include "sysfs.h"
+#include "procpower.h"
+
+// Process power attribution
+//
+// The CPU time a thread consumed since the previous update is charged to the
+// core it last ran on (utime + stime and processor of
+// /proc/<pid>/task/<tid>/stat), and each core's RAPL power is split between
+// the threads in proportion to their share of that core's time. A process
+// gets the sum over its threads, so a multi-threaded job is charged on every
+// core it runs on. Time nobody accounts for (idle) keeps its share of the
+// power unattributed.
+//
+// Most processes sleep through most updates. Each update reads only the
+// process stat of every process, through a descriptor that stays open, and
+// walks the threads only of processes whose total CPU time moved.
+
+typedef struct {
+    gint fd;
+    guint generation;
+    guint64 ticks;
+    gint core;
+    guint64 delta;
+} ThreadEntry;
+
+typedef struct {
+    gint pid;
+    gint fd;
+    guint generation;
+    guint64 ticks;
+    guint64 start;              // clock ticks after boot, tells a reused pid apart
+    gboolean ran;               // CPU time moved during the last update
+    GHashTable *threads;        // tid -> ThreadEntry
+    gfloat power;
+    gchar comm[PROCPOWER_COMM_LEN];
+} ProcEntry;
+
+static GHashTable *procs = NULL;
+static gint *cpu_core_map = NULL;
+static guint ncpus = 0;
+static guint cores = 0;
+static guint *threads_per_core = NULL;
+static guint64 *core_ticks = NULL;
+static guint generation = 0;
+static gint64 last_update = 0;
+static guint64 last_boot_ticks = 0;
+static glong clk_tck = 100;
+
+static guint64 boot_ticks() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec * clk_tck + ts.tv_nsec / (1000000000 / clk_tck);
+}
+
+static void thread_entry_free(gpointer data) {
+    ThreadEntry *t = data;
+
+    if (t->fd >= 0)
+        close(t->fd);
+    g_free(t);
+}
+
+static void proc_entry_free(gpointer data) {
+    ProcEntry *e = data;
+
+    if (e->fd >= 0)
+        close(e->fd);
+    g_hash_table_destroy(e->threads);
+    g_free(e);
+}
+
+// Reads through fd when there is one, otherwise opens path for this read only.
+// start and comm may be NULL.
+static gboolean read_stat(gint fd, const gchar *path, guint64 *ticks, gint *cpu, guint64 *start, gchar *comm) {
+    gchar buf[1024];
+    gchar *p, *end;
+    gssize len;
+    gint field;
+    gint own = -1;
+
+    if (fd < 0) {
+        // No spare descriptor, fall back to open/read/close
+        fd = own = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return FALSE;
+    }
+
+    len = pread(fd, buf, sizeof buf - 1, 0);
+    if (own >= 0)
+        close(own);
+    if (len <= 0)
+        return FALSE;
+    buf[len] = 0;
+
+    // comm may contain spaces and parentheses, the fields start after the last ')'
+    p = strrchr(buf, ')');
+    if (!p)
+        return FALSE;
+
+    // Always refreshed, exec changes it
+    if (comm) {
+        end = strchr(buf, '(');
+        if (end && p > end + 1)
+            g_strlcpy(comm, end + 1, MIN((gsize)(p - end), PROCPOWER_COMM_LEN));
+    }
+
+    // p points at field 2 (comm), utime and stime are fields 14 and 15,
+    // starttime is field 22 and processor field 39
+    *ticks = 0;
+    *cpu = -1;
+    for (field = 2; field < 39 && p; field++) {
+        p = strchr(p + 1, ' ');
+        if (!p)
+            break;
+        if (field + 1 == 14 || field + 1 == 15)
+            *ticks += g_ascii_strtoull(p + 1, NULL, 10);
+        else if (field + 1 == 22 && start)
+            *start = g_ascii_strtoull(p + 1, NULL, 10);
+        else if (field + 1 == 39)
+            *cpu = atoi(p + 1);
+    }
+
+    return *cpu >= 0;
+}
+
+static gint open_stat(const gchar *path) {
+    gint fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    // Out of descriptors is not fatal, read_stat opens the file each time
+    if (fd < 0 && (errno == EMFILE || errno == ENFILE))
+        return -1;
+    return fd < 0 ? -2 : fd;
+}
+
+static ProcEntry *proc_entry_new(gint pid) {
+    ProcEntry *e;
+    gchar path[32];
+    gint cpu;
+
+    e = g_new0(ProcEntry, 1);
+    e->pid = pid;
+    e->threads = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, thread_entry_free);
+
+    g_snprintf(path, sizeof path, "/proc/%d/stat", pid);
+    e->fd = open_stat(path);
+    if (e->fd == -2 || !read_stat(e->fd, path, &e->ticks, &cpu, &e->start, e->comm)) {
+        e->fd = MAX(e->fd, -1);
+        proc_entry_free(e);
+        return NULL;
+    }
+
+    return e;
+}
+
+static gboolean remove_stale(gpointer key, gpointer value, gpointer user_data) {
+    return ((ProcEntry*)value)->generation != generation;
+}
+
+gboolean procpower_init(void) {
+    struct rlimit rl;
+    guint i;
+
+    if (procs)
+        return TRUE;
+
+    if (!core_power)
+        return FALSE;
+
+    cores = get_core_count();
+    cpu_core_map = get_cpu_core_map(&ncpus);
+    if (!cpu_core_map || cores == 0)
+        return FALSE;
+
+    threads_per_core = g_new0(guint, cores);
+    for (i = 0; i < ncpus; i++) {
+        if (cpu_core_map[i] >= 0)
+            threads_per_core[cpu_core_map[i]]++;
+    }
+    core_ticks = g_new0(guint64, cores);
+
+    // Keeping descriptors open needs more than the usual soft limit
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    clk_tck = sysconf(_SC_CLK_TCK);
+    procs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, proc_entry_free);
+    last_update = g_get_monotonic_time();
+    last_boot_ticks = boot_ticks();
+
+    return TRUE;
+}
+
+// Attribution needs every core's power while it runs, whether or not the
+// cores are on screen
+void procpower_set_active(gboolean active) {
+    msr_observe_core_power(active);
+}
+
+static gboolean thread_stale(gpointer key, gpointer value, gpointer user_data) {
+    return ((ThreadEntry*)value)->generation != generation;
+}
+
+// Charges the threads of e to their cores. A thread seen for the first time
+// is charged all of its time when fresh: its process was walked before, so
+// the thread's time all accrued since then. FALSE when the process is gone.
+static gboolean update_threads(ProcEntry *e, gboolean fresh) {
+    GDir *dir;
+    ThreadEntry *t;
+    const gchar *name;
+    gchar path[48];
+    guint64 ticks;
+    gint tid, cpu;
+
+    g_snprintf(path, sizeof path, "/proc/%d/task", e->pid);
+    dir = g_dir_open(path, 0, NULL);
+    if (!dir)
+        return FALSE;
+
+    while ((name = g_dir_read_name(dir))) {
+        tid = atoi(name);
+        if (tid <= 0)
+            continue;
+
+        g_snprintf(path, sizeof path, "/proc/%d/task/%d/stat", e->pid, tid);
+        t = g_hash_table_lookup(e->threads, GINT_TO_POINTER(tid));
+        if (!t) {
+            t = g_new0(ThreadEntry, 1);
+            t->fd = open_stat(path);
+            if (t->fd == -2 || !read_stat(t->fd, path, &ticks, &cpu, NULL, NULL)) {
+                t->fd = MAX(t->fd, -1);
+                thread_entry_free(t);
+                continue;
+            }
+            g_hash_table_insert(e->threads, GINT_TO_POINTER(tid), t);
+            t->ticks = fresh ? 0 : ticks;
+        }
+        else if (!read_stat(t->fd, path, &ticks, &cpu, NULL, NULL)) {
+            // Exited, or the tid was reused and the old descriptor is dead
+            g_hash_table_remove(e->threads, GINT_TO_POINTER(tid));
+            continue;
+        }
+
+        t->generation = generation;
+        t->delta = ticks >= t->ticks ? ticks - t->ticks : 0;
+        t->ticks = ticks;
+        t->core = cpu < ncpus ? cpu_core_map[cpu] : -1;
+        if (t->core >= 0)
+            core_ticks[t->core] += t->delta;
+    }
+    g_dir_close(dir);
+
+    g_hash_table_foreach_remove(e->threads, thread_stale, NULL);
+    return TRUE;
+}
+
+// FALSE when the process is gone
+static gboolean update_proc(ProcEntry *e) {
+    gchar path[32];
+    guint64 ticks, start;
+    gint cpu;
+
+    g_snprintf(path, sizeof path, "/proc/%d/stat", e->pid);
+    if (!read_stat(e->fd, path, &ticks, &cpu, &start, e->comm))
+        return FALSE;
+
+    if (start != e->start) {
+        // Same pid, different process: start over as if just seen
+        g_hash_table_remove_all(e->threads);
+        e->start = start;
+        e->ticks = ticks;
+        e->ran = start >= last_boot_ticks;
+        return update_threads(e, e->ran);
+    }
+
+    e->ran = ticks != e->ticks;
+    e->ticks = ticks;
+    return !e->ran || update_threads(e, TRUE);
+}
+
+void procpower_update(void) {
+    GDir *dir;
+    GHashTableIter iter, titer;
+    const gchar *name;
+    ProcEntry *e;
+    ThreadEntry *t;
+    gpointer value;
+    guint64 capacity, walk_start;
+    gdouble dt;
+    gint64 now;
+    gint pid;
+
+    if (!procs)
+        return;
+
+    dir = g_dir_open("/proc", 0, NULL);
+    if (!dir)
+        return;
+
+    now = g_get_monotonic_time();
+    dt = (now - last_update) / 1000000.0;
+    last_update = now;
+
+    generation++;
+    memset(core_ticks, 0, cores * sizeof(*core_ticks));
+
+    // Processes that start while /proc is walked may be missed until the
+    // next update, which then still takes them as new
+    walk_start = boot_ticks();
+
+    while ((name = g_dir_read_name(dir))) {
+        if (!g_ascii_isdigit(name[0]))
+            continue;
+
+        pid = atoi(name);
+        e = g_hash_table_lookup(procs, GINT_TO_POINTER(pid));
+        if (!e) {
+            // Started since the last update: all of its time is new. Otherwise
+            // this only records where its threads stand.
+            e = proc_entry_new(pid);
+            if (!e)
+                continue;
+            g_hash_table_insert(procs, GINT_TO_POINTER(pid), e);
+            e->ran = e->start >= last_boot_ticks;
+            if (!update_threads(e, e->ran)) {
+                g_hash_table_remove(procs, GINT_TO_POINTER(pid));
+                continue;
+            }
+        }
+        else if (!update_proc(e)) {
+            g_hash_table_remove(procs, GINT_TO_POINTER(pid));
+            continue;
+        }
+        e->generation = generation;
+    }
+    g_dir_close(dir);
+    last_boot_ticks = walk_start;
+
+    g_hash_table_foreach_remove(procs, remove_stale, NULL);
+
+    g_hash_table_iter_init(&iter, procs);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        e = value;
+        e->power = 0;
+        if (!e->ran)
+            continue;
+
+        g_hash_table_iter_init(&titer, e->threads);
+        while (g_hash_table_iter_next(&titer, NULL, &value)) {
+            t = value;
+            if (t->core < 0 || t->delta == 0 || core_power[t->core] == ERROR_VALUE)
+                continue;
+
+            capacity = dt * clk_tck * MAX(threads_per_core[t->core], 1);
+            e->power += core_power[t->core] * t->delta / MAX(core_ticks[t->core], capacity);
+        }
+    }
+}
+
+guint procpower_top(ProcPower *top, guint n) {
+    GHashTableIter iter;
+    gpointer value;
+    ProcEntry *e;
+    guint count = 0, i;
+
+    if (!procs || n == 0)
+        return 0;
+
+    // Insertion into a bounded, sorted array: O(processes * n) with small n
+    g_hash_table_iter_init(&iter, procs);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        e = value;
+        if (e->power <= 0)
+            continue;
+        if (count == n && e->power <= top[n - 1].power)
+            continue;
+
+        i = count < n ? count++ : n - 1;
+        while (i > 0 && top[i - 1].power < e->power) {
+            top[i] = top[i - 1];
+            i--;
+        }
+        top[i].pid = e->pid;
+        top[i].power = e->power;
+        memcpy(top[i].comm, e->comm, sizeof top[i].comm);
+    }
+
+    return count;
+}
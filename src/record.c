@@ -0,0 +1,93 @@
+#include <glib.h>
+#include <signal.h>
+#include "zenmonitor.h"
+#include "procpower.h"
+#include "freqhist.h"
+#include "zmlog.h"
+#include "record.h"
+#include "alerts.h"
+
+static volatile sig_atomic_t stop_recording = 0;
+
+static void record_signal(int signum) {
+    stop_recording = 1;
+}
+
+gboolean record_run(SensorSource *sources, const gchar *filename, guint interval_ms, gboolean proc_power) {
+    SensorSource *source;
+    ZmLogWriter *writer;
+    ProcPower top[PROCPOWER_TOP];
+    FreqHist *hist;
+    gint64 next, now;
+    guint enabled = 0, ticks = 0;
+    gboolean ok = TRUE;
+
+    // Every sensor ends up in the log
+    enabled = sensor_sources_init(sources);
+    for (source = sources; source->drv; source++) {
+        if (source->enabled)
+            sensor_source_observe_all(source);
+    }
+
+    if (enabled == 0) {
+        g_printerr("record: no sensors available\n");
+        return FALSE;
+    }
+
+    if (proc_power && !procpower_init()) {
+        g_printerr("record: process power needs MSR access, not recording it\n");
+        proc_power = FALSE;
+    }
+
+    alerts_bind(sources);
+    hist = freqhist_new(sources, hist_bin_mhz);
+
+    writer = zmlog_writer_new(filename, sources, interval_ms * 1000);
+    if (!writer) {
+        g_printerr("record: unable to create %s\n", filename);
+        return FALSE;
+    }
+
+    signal(SIGINT, record_signal);
+    signal(SIGTERM, record_signal);
+    g_print("record: writing to %s every %u ms, stop with Ctrl+C\n", filename, interval_ms);
+
+    next = g_get_monotonic_time();
+    while (!stop_recording && ok) {
+        for (source = sources; source->drv; source++) {
+            if (source->enabled)
+                source->func_update();
+        }
+        alerts_evaluate();
+        if (proc_power) {
+            procpower_update();
+            zmlog_writer_append_procs(writer, top, procpower_top(top, PROCPOWER_TOP));
+        }
+        if (hist) {
+            freqhist_update(hist);
+            // One cumulative snapshot per chunk, written along with it
+            if (++ticks % ZMLOG_CHUNK_ROWS == 0)
+                zmlog_writer_append_hist(writer, hist);
+        }
+        ok = zmlog_writer_append(writer);
+
+        next += interval_ms * 1000;
+        now = g_get_monotonic_time();
+        if (next > now)
+            g_usleep(next - now);
+        else
+            next = now;
+    }
+
+    if (hist) {
+        zmlog_writer_append_hist(writer, hist);
+        freqhist_free(hist);
+    }
+
+    if (!zmlog_writer_close(writer) || !ok) {
+        g_printerr("record: error while writing %s\n", filename);
+        return FALSE;
+    }
+
+    return TRUE;
+}
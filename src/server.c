@@ -0,0 +1,276 @@
+#define _GNU_SOURCE
+#include <glib.h>
+#include <errno.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "zenmonitor.h"
+#include "remote.h"
+#include "server.h"
+#include "alerts.h"
+
+#define SERVER_MAX_CLIENTS 32
+
+static volatile sig_atomic_t stop_server = 0;
+
+static SensorSource *sensor_sources;
+static GByteArray *hello = NULL;
+static GByteArray *frame = NULL;
+static const SensorInit **sensors = NULL;
+static guint sensor_count = 0;
+
+static void server_signal(int signum) {
+    stop_server = 1;
+}
+
+static void put_str(GByteArray *buf, const gchar *s) {
+    guint16 len = s ? MIN(strlen(s), G_MAXUINT16) : 0;
+
+    g_byte_array_append(buf, (const guint8*)&len, sizeof len);
+    g_byte_array_append(buf, (const guint8*)s, len);
+}
+
+static void build_hello(guint interval_ms) {
+    RemoteHello h = { REMOTE_MAGIC, REMOTE_VERSION, REMOTE_MSG_HELLO, 0, interval_ms };
+    SensorSource *source;
+    GSList *node;
+    const SensorInit *data;
+    RemoteTopology topology;
+    guint i = 0;
+
+    for (source = sensor_sources; source->drv; source++) {
+        if (source->enabled)
+            sensor_count += g_slist_length(source->sensors);
+    }
+
+    h.sensor_count = sensor_count;
+    sensors = g_new(const SensorInit*, sensor_count);
+    hello = g_byte_array_new();
+    g_byte_array_append(hello, (const guint8*)&h, sizeof h);
+
+    for (source = sensor_sources; source->drv; source++) {
+        if (!source->enabled)
+            continue;
+
+        for (node = source->sensors; node; node = node->next) {
+            data = node->data;
+            put_str(hello, source->drv);
+            put_str(hello, data->label);
+            put_str(hello, data->hint);
+            put_str(hello, data->printf_format);
+            topology = (RemoteTopology) { data->node, data->ccx, data->core, data->aggregate };
+            g_byte_array_append(hello, (const guint8*)&topology, sizeof topology);
+            sensors[i++] = data;
+        }
+    }
+
+    frame = g_byte_array_sized_new(sizeof(RemoteFrame) + sensor_count * sizeof(RemoteValue));
+    g_byte_array_set_size(frame, sizeof(RemoteFrame) + sensor_count * sizeof(RemoteValue));
+}
+
+// One hardware read per tick, for alerts and for the frame
+static void sample() {
+    SensorSource *source;
+
+    for (source = sensor_sources; source->drv; source++) {
+        if (source->enabled)
+            source->func_update();
+    }
+
+    alerts_evaluate();
+}
+
+// The same frame goes to every client
+static void build_frame(guint32 seq) {
+    RemoteFrame *f = (RemoteFrame*)frame->data;
+    RemoteValue *v = (RemoteValue*)(frame->data + sizeof(RemoteFrame));
+    guint i;
+
+    f->magic = REMOTE_MAGIC;
+    f->version = REMOTE_VERSION;
+    f->type = REMOTE_MSG_FRAME;
+    f->seq = seq;
+    f->sensor_count = sensor_count;
+    f->timestamp = g_get_monotonic_time();
+
+    for (i = 0; i < sensor_count; i++) {
+        v[i].value = *sensors[i]->value;
+        v[i].min = *sensors[i]->min;
+        v[i].max = *sensors[i]->max;
+        v[i].stale = sensors[i]->stale;
+    }
+}
+
+// The MSR driver checks for CAP_SYS_RAWIO on open only, and every source
+// keeps its files open, so nothing past init needs root. Plugins, alert
+// hooks and notify-send then run as the unprivileged user.
+static gboolean drop_privileges(const gchar *user) {
+    struct passwd *pw;
+
+    if (geteuid() != 0)
+        return TRUE;
+
+    pw = getpwnam(user);
+    if (!pw) {
+        g_printerr("server: no user %s\n", user);
+        return FALSE;
+    }
+
+    if (setgroups(0, NULL) != 0 || setgid(pw->pw_gid) != 0 || setuid(pw->pw_uid) != 0) {
+        g_printerr("server: unable to switch to user %s: %s\n", user, g_strerror(errno));
+        return FALSE;
+    }
+
+    g_setenv("HOME", pw->pw_dir, TRUE);
+    g_setenv("USER", pw->pw_name, TRUE);
+    return TRUE;
+}
+
+static gint open_socket(const gchar *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    gint fd;
+
+    if (strlen(path) >= sizeof addr.sun_path)
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof addr) < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // Clients run unprivileged; all they can do is read frames
+    chmod(path, 0666);
+    return fd;
+}
+
+gboolean server_run(SensorSource *sources, const gchar *path, guint interval_ms, const gchar *user) {
+    struct pollfd fds[SERVER_MAX_CLIENTS + 1];
+    SensorSource *source;
+    guint nclients = 0, enabled = 0, i;
+    gboolean alerting;
+    gint64 next, now;
+    guint32 seq = 0;
+    gint listen_fd, fd, timeout;
+    gchar buf[64];
+
+    sensor_sources = sources;
+    // Clients pick what they show, the frame always carries everything
+    enabled = sensor_sources_init(sensor_sources);
+    for (source = sensor_sources; source->drv; source++) {
+        if (source->enabled)
+            sensor_source_observe_all(source);
+    }
+
+    if (enabled == 0) {
+        g_printerr("server: no sensors available\n");
+        return FALSE;
+    }
+
+    build_hello(interval_ms);
+    alerts_bind(sensor_sources);
+    alerting = alerts_active();
+
+    listen_fd = open_socket(path);
+    if (listen_fd < 0) {
+        g_printerr("server: unable to listen on %s: %s\n", path, g_strerror(errno));
+        return FALSE;
+    }
+
+    // The socket usually lives in /run, bind it before giving up root
+    if (!drop_privileges(user)) {
+        close(listen_fd);
+        unlink(path);
+        return FALSE;
+    }
+
+    signal(SIGINT, server_signal);
+    signal(SIGTERM, server_signal);
+    signal(SIGPIPE, SIG_IGN);
+    g_print("server: %u sensors, serving on %s every %u ms\n", sensor_count, path, interval_ms);
+
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    next = g_get_monotonic_time();
+
+    while (!stop_server) {
+        now = g_get_monotonic_time();
+        timeout = next > now ? (next - now) / 1000 : 0;
+
+        if (poll(fds, nclients + 1, nclients || alerting ? timeout : -1) < 0 && errno != EINTR)
+            break;
+
+        if (fds[0].revents & POLLIN) {
+            fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0) {
+                if (nclients < SERVER_MAX_CLIENTS && send(fd, hello->data, hello->len, MSG_NOSIGNAL) == (gssize)hello->len) {
+                    nclients++;
+                    fds[nclients].fd = fd;
+                    fds[nclients].events = POLLIN;
+                    fds[nclients].revents = 0;
+                    if (nclients == 1 && !alerting)
+                        next = g_get_monotonic_time();
+                }
+                else {
+                    close(fd);
+                }
+            }
+        }
+
+        for (i = 1; i <= nclients; i++) {
+            if (!fds[i].revents)
+                continue;
+
+            // Server state is shared, nothing a client says changes it
+            if ((fds[i].revents & POLLIN) && recv(fds[i].fd, buf, sizeof buf, 0) > 0)
+                continue;
+
+            // Hang-up or error, drop the client
+            close(fds[i].fd);
+            fds[i] = fds[nclients];
+            nclients--;
+            i--;
+        }
+
+        // Nobody is listening and no rule is watching, do not touch the hardware
+        if ((nclients == 0 && !alerting) || g_get_monotonic_time() < next)
+            continue;
+
+        sample();
+        if (nclients > 0)
+            build_frame(seq++);
+        for (i = 1; i <= nclients; i++) {
+            // A client that is not keeping up just misses this frame
+            if (send(fds[i].fd, frame->data, frame->len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0 &&
+                errno != EAGAIN && errno != EWOULDBLOCK) {
+                close(fds[i].fd);
+                fds[i] = fds[nclients];
+                nclients--;
+                i--;
+            }
+        }
+
+        next += interval_ms * 1000;
+        now = g_get_monotonic_time();
+        if (next < now)
+            next = now;
+    }
+
+    for (i = 1; i <= nclients; i++)
+        close(fds[i].fd);
+    close(listen_fd);
+    unlink(path);
+
+    return TRUE;
+}
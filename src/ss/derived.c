@@ -0,0 +1,207 @@
+#include <glib.h>
+#include "zenmonitor.h"
+#include "msr.h"
+#include "hwmon.h"
+#include "derived.h"
+
+#define DERIVED_PWR_PRINTF_FORMAT " %8.3f W"
+#define DERIVED_RATIO_PRINTF_FORMAT " %8.3f"
+
+// Computed per socket from what msr and hwmon already read, no hardware access
+typedef struct {
+    gint node;
+    SensorInit *package;        // RAPL package power
+    SensorInit *svi2;           // SVI2 core power
+    GPtrArray *cores;           // RAPL core power
+
+    SensorInit *uncore_sensor;
+    gfloat uncore;
+    gfloat uncore_min;
+    gfloat uncore_max;
+
+    SensorInit *ratio_sensor;
+    gfloat ratio;
+    gfloat ratio_min;
+    gfloat ratio_max;
+
+    // Energy weighted, since start or the last clear
+    SensorInit *mean_sensor;
+    gdouble rapl_energy;
+    gdouble svi2_energy;
+    gfloat mean;
+    gfloat mean_min;
+    gfloat mean_max;
+} DerivedNode;
+
+static GPtrArray *nodes = NULL;
+static gint64 last_update = 0;
+
+static DerivedNode* node_get(gint id) {
+    DerivedNode *n;
+    guint i;
+
+    for (i = 0; i < nodes->len; i++) {
+        n = g_ptr_array_index(nodes, i);
+        if (n->node == id)
+            return n;
+    }
+
+    n = g_new0(DerivedNode, 1);
+    n->node = id;
+    n->cores = g_ptr_array_new();
+    n->uncore = n->uncore_min = n->uncore_max = ERROR_VALUE;
+    n->ratio = n->ratio_min = n->ratio_max = ERROR_VALUE;
+    n->mean = n->mean_min = n->mean_max = ERROR_VALUE;
+    g_ptr_array_add(nodes, n);
+    return n;
+}
+
+gboolean derived_init() {
+    DerivedNode *n;
+    guint i;
+
+    if (nodes)
+        return nodes->len > 0;
+    nodes = g_ptr_array_new();
+
+    for (i = 0; sensor_source_sensors("msr") && i < msr_node_count(); i++) {
+        n = node_get(i);
+        n->package = msr_package_sensor(i);
+        g_ptr_array_free(n->cores, TRUE);
+        n->cores = msr_core_power_sensors(i);
+        if (sensor_source_sensors("hwmon"))
+            n->svi2 = hwmon_core_power_sensor(i);
+    }
+
+    // Both derived values need the per-core RAPL readings
+    for (i = nodes->len; i-- > 0;) {
+        n = g_ptr_array_index(nodes, i);
+        if (n->cores->len == 0 || (!n->package && !n->svi2))
+            g_ptr_array_remove_index(nodes, i);
+    }
+
+    if (nodes->len == 0)
+        return FALSE;
+
+    derived_update();
+    return TRUE;
+}
+
+void derived_update() {
+    DerivedNode *n;
+    gboolean ratio_needed, mean_needed;
+    gfloat cores, svi2;
+    gdouble dt;
+    gint64 now;
+    guint i;
+
+    // Power times the time it was held for, ticks are not evenly spaced
+    now = g_get_monotonic_time();
+    dt = last_update ? (now - last_update) / 1e6 : 0;
+    last_update = now;
+
+    for (i = 0; i < nodes->len; i++) {
+        n = g_ptr_array_index(nodes, i);
+
+        if (n->package && sensor_needed(n->uncore_sensor)) {
+            cores = sensors_sum(n->cores);
+            if (cores != ERROR_VALUE && *n->package->value != ERROR_VALUE)
+                sensor_track(*n->package->value - cores, &n->uncore, &n->uncore_min, &n->uncore_max);
+            else
+                n->uncore = ERROR_VALUE;
+        }
+
+        if (!n->svi2)
+            continue;
+
+        // The mean only stays exact while one of the two is observed
+        ratio_needed = sensor_needed(n->ratio_sensor);
+        mean_needed = sensor_needed(n->mean_sensor);
+        if (!ratio_needed && !mean_needed)
+            continue;
+
+        cores = sensors_sum(n->cores);
+        svi2 = *n->svi2->value;
+        if (cores == ERROR_VALUE || svi2 == ERROR_VALUE || svi2 <= 0) {
+            n->ratio = ERROR_VALUE;
+            continue;
+        }
+
+        sensor_track(cores / svi2, &n->ratio, &n->ratio_min, &n->ratio_max);
+        n->rapl_energy += cores * dt;
+        n->svi2_energy += svi2 * dt;
+        if (n->svi2_energy > 0)
+            sensor_track(n->rapl_energy / n->svi2_energy, &n->mean, &n->mean_min, &n->mean_max);
+    }
+}
+
+void derived_clear_minmax() {
+    DerivedNode *n;
+    guint i;
+
+    for (i = 0; i < nodes->len; i++) {
+        n = g_ptr_array_index(nodes, i);
+        n->uncore_min = n->uncore_max = n->uncore;
+        n->ratio_min = n->ratio_max = n->ratio;
+        n->rapl_energy = n->svi2_energy = 0;
+        n->mean_min = n->mean_max = n->mean;
+    }
+}
+
+static SensorInit* new_sensor(DerivedNode *n, const gchar *label, const gchar *hint, const gchar *printf_format,
+                              gfloat *value, gfloat *min, gfloat *max) {
+    SensorInit *data;
+    guint i;
+
+    data = sensor_init_new();
+    if (nodes->len > 1)
+        data->label = g_strdup_printf("Node %d - %s", n->node, label);
+    else
+        data->label = g_strdup(label);
+    data->hint = g_strdup(hint);
+    data->value = value;
+    data->min = min;
+    data->max = max;
+    data->printf_format = printf_format;
+    data->node = n->node;
+
+    for (i = 0; i < n->cores->len; i++)
+        data->deps = g_slist_prepend(data->deps, g_ptr_array_index(n->cores, i));
+    return data;
+}
+
+GSList* derived_get_sensors() {
+    GSList *list = NULL;
+    DerivedNode *n;
+    guint i;
+
+    for (i = 0; i < nodes->len; i++) {
+        n = g_ptr_array_index(nodes, i);
+
+        if (n->package) {
+            n->uncore_sensor = new_sensor(n, "Uncore Power",
+                                          "Package Power minus the sum of Core Power, both from RAPL\n"
+                                          "Power of the SoC, caches and interconnect",
+                                          DERIVED_PWR_PRINTF_FORMAT, &n->uncore, &n->uncore_min, &n->uncore_max);
+            n->uncore_sensor->deps = g_slist_prepend(n->uncore_sensor->deps, n->package);
+            n->uncore_sensor->aggregate = SENSOR_AGG_SUM;
+            list = g_slist_append(list, n->uncore_sensor);
+        }
+
+        if (n->svi2) {
+            n->ratio_sensor = new_sensor(n, "Core Power RAPL/SVI2",
+                                         "Sum of RAPL Core Power divided by CPU Core Power (SVI2)",
+                                         DERIVED_RATIO_PRINTF_FORMAT, &n->ratio, &n->ratio_min, &n->ratio_max);
+            n->ratio_sensor->deps = g_slist_prepend(n->ratio_sensor->deps, n->svi2);
+            list = g_slist_append(list, n->ratio_sensor);
+
+            n->mean_sensor = new_sensor(n, "Core Power RAPL/SVI2 (mean)",
+                                        "RAPL/SVI2 ratio of the energy since start or the last Min/Max clear",
+                                        DERIVED_RATIO_PRINTF_FORMAT, &n->mean, &n->mean_min, &n->mean_max);
+            n->mean_sensor->deps = g_slist_prepend(n->mean_sensor->deps, n->svi2);
+            list = g_slist_append(list, n->mean_sensor);
+        }
+    }
+
+    return list;
+}
@@ -0,0 +1,549 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "zenmonitor.h"
+#include "hwmon.h"
+#include "sysfs.h"
+#include "manifest.h"
+
+#define HWMON_DIR "/sys/class/hwmon"
+
+// Attribute kinds, matched on the file name: <prefix><n><suffix>
+typedef struct
+{
+    const gchar *prefix;
+    const gchar *suffix;
+    const gchar *noun;
+    const gchar *printf_format;
+    const double adjust_ratio;
+    SensorAggregate aggregate;
+} HwmonKind;
+
+static const HwmonKind hwmon_kinds[] = {
+  {"temp",  "_input",   "Temperature", " %6.2f°C",   1000.0,    SENSOR_AGG_MAX},
+  {"in",    "_input",   "Voltage",     " %8.3f V",   1000.0,    SENSOR_AGG_NONE},
+  {"curr",  "_input",   "Current",     " %8.3f A",   1000.0,    SENSOR_AGG_NONE},
+  {"power", "_input",   "Power",       " %8.3f W",   1000000.0, SENSOR_AGG_NONE},
+  {"power", "_average", "Power",       " %8.3f W",   1000000.0, SENSOR_AGG_NONE},
+  {"fan",   "_input",   "Fan",         " %6.0f RPM", 1.0,       SENSOR_AGG_NONE},
+  {0, NULL}
+};
+
+// Drivers that are picked up, matched on the hwmon "name" attribute
+typedef struct
+{
+    const gchar *name;
+    const gboolean prefix_match;
+    const gchar *title;         // prepended to labels not found in hwmon_labels
+    const gboolean cpu;         // one device per CPU package
+} HwmonDriver;
+
+static const HwmonDriver hwmon_drivers[] = {
+  {"zenpower", FALSE, "CPU",   TRUE},
+  {"k10temp",  FALSE, "CPU",   TRUE},
+  {"amdgpu",   FALSE, "GPU",   FALSE},
+  {"nct67",    TRUE,  "Board", FALSE},
+  {0, FALSE}
+};
+
+// Known *_label contents. A trailing '#' matches a number, which replaces
+// %s in the label and hint.
+typedef struct
+{
+    const gchar *driver_label;
+    const gchar *label;
+    const gchar *hint;
+} HwmonLabel;
+
+static const HwmonLabel hwmon_labels[] = {
+  {"Tctl",        "CPU Temperature (tCtl)",  "Reported CPU Temperature"},
+  {"Tdie",        "CPU Temperature (tDie)",  "Reported CPU Temperature - offset"},
+  {"Tccd#",       "CCD%s Temperature",       "Core Complex Die %s Temperature"},
+  {"SVI2_Core",   "CPU Core Voltage (SVI2)", "Core Voltage reported by SVI2 telemetry"},
+  {"SVI2_SoC",    "SOC Voltage (SVI2)",      "SOC Voltage reported by SVI2 telemetry"},
+  {"SVI2_C_Core", "CPU Core Current (SVI2)", "Core Current reported by SVI2 telemetry\n"
+                                             "Note: May not be accurate on some systems"},
+  {"SVI2_C_SoC",  "SOC Current (SVI2)",      "SOC Current reported by SVI2 telemetry\n"
+                                             "Note: May not be accurate on some systems"},
+  {"SVI2_P_Core", "CPU Core Power (SVI2)",   "Core Voltage * Current\n"
+                                             "Note: May not be accurate on some systems"},
+  {"SVI2_P_SoC",  "SOC Power (SVI2)",        "Core Voltage * Current\n"
+                                             "Note: May not be accurate on some systems"},
+  {"Vcore",       "CPU Core Voltage (SVI2)", "Core Voltage reported by SVI2 telemetry"},
+  {"Vsoc",        "SOC Voltage (SVI2)",      "SOC Voltage reported by SVI2 telemetry"},
+  {"Icore",       "CPU Core Current (SVI2)", "Core Current reported by SVI2 telemetry"},
+  {"Isoc",        "SOC Current (SVI2)",      "SOC Current reported by SVI2 telemetry"},
+  {0, NULL}
+};
+
+typedef struct
+{
+    float current_value;
+    float min;
+    float max;
+    const HwmonKind *kind;
+    guint index;
+    gchar *path;
+    gchar *label;
+    gchar *hint;
+    gint fd;
+    gint node;                  // physical package of CPU devices, else -1
+    gboolean core_power;        // SVI2 core power, matched on the driver's label
+    gchar *manifest;
+    SensorInit *init;
+} HwmonSensor;
+
+// Discovery runs once, later calls reuse the result
+static GSList *hw_sensors = NULL;
+static gboolean discovered = FALSE;
+
+static gchar* read_attr(const gchar *dir, const gchar *attr) {
+    gchar *path, *data = NULL;
+
+    path = g_strdup_printf(HWMON_DIR "/%s/%s", dir, attr);
+    if (!g_file_get_contents(path, &data, NULL, NULL))
+        data = NULL;
+    g_free(path);
+
+    return data ? g_strchomp(data) : NULL;
+}
+
+static gboolean read_value(HwmonSensor *sensor) {
+    gchar buf[32];
+    gssize len;
+
+    len = pread(sensor->fd, buf, sizeof buf - 1, 0);
+    if (len <= 0)
+        return FALSE;
+
+    buf[len] = 0;
+    sensor->current_value = atof(buf) / sensor->kind->adjust_ratio;
+    return TRUE;
+}
+
+static const HwmonDriver* match_driver(const gchar *name) {
+    const HwmonDriver *driver;
+
+    for (driver = hwmon_drivers; driver->name; driver++) {
+        if (driver->prefix_match ? g_str_has_prefix(name, driver->name) : strcmp(name, driver->name) == 0)
+            return driver;
+    }
+    return NULL;
+}
+
+// Returns the attribute number if file is <prefix><n><suffix>
+static gint match_kind(const gchar *file, const HwmonKind *kind) {
+    const gchar *p;
+    gchar *end;
+    glong n;
+
+    if (!g_str_has_prefix(file, kind->prefix))
+        return -1;
+
+    p = file + strlen(kind->prefix);
+    if (!g_ascii_isdigit(*p))
+        return -1;
+
+    n = strtol(p, &end, 10);
+    return strcmp(end, kind->suffix) == 0 ? n : -1;
+}
+
+static void resolve_label(HwmonSensor *sensor, const gchar *title, const gchar *stem, const gchar *raw) {
+    const HwmonLabel *l;
+    gsize len;
+
+    for (l = hwmon_labels; raw && l->driver_label; l++) {
+        len = strlen(l->driver_label);
+        if (l->driver_label[len - 1] == '#') {
+            if (strncmp(raw, l->driver_label, len - 1) == 0 && g_ascii_isdigit(raw[len - 1])) {
+                sensor->label = g_strdup_printf(l->label, raw + len - 1);
+                sensor->hint = g_strdup_printf(l->hint, raw + len - 1);
+                return;
+            }
+        }
+        else if (strcmp(raw, l->driver_label) == 0) {
+            sensor->label = g_strdup(l->label);
+            sensor->hint = g_strdup(l->hint);
+            return;
+        }
+    }
+
+    if (raw)
+        sensor->label = g_strdup_printf("%s %s %s", title, raw, sensor->kind->noun);
+    else
+        sensor->label = g_strdup_printf("%s %s", title, stem);
+    sensor->hint = g_strdup(sensor->kind->noun);
+}
+
+static gint compare_sensors(gconstpointer a, gconstpointer b) {
+    const HwmonSensor *sa = a, *sb = b;
+
+    if (sa->kind != sb->kind)
+        return sa->kind - sb->kind;
+    return (gint)sa->index - (gint)sb->index;
+}
+
+static const HwmonKind* find_kind(const gchar *file, gint *n) {
+    const HwmonKind *kind;
+
+    for (kind = hwmon_kinds; kind->prefix; kind++) {
+        *n = match_kind(file, kind);
+        if (*n >= 0)
+            return kind;
+    }
+    return NULL;
+}
+
+// Opens and reads the attribute once, NULL if it does not work
+static HwmonSensor* new_sensor(const gchar *entry, const gchar *name, const gchar *file, const HwmonKind *kind,
+                               gint n, gint node, const gchar *title, const gchar *raw) {
+    HwmonSensor *sensor;
+    gchar *stem, *hint;
+
+    sensor = g_new0(HwmonSensor, 1);
+    sensor->kind = kind;
+    sensor->index = n;
+    sensor->node = node;
+    sensor->path = g_strdup_printf(HWMON_DIR "/%s/%s", entry, file);
+    sensor->fd = open(sensor->path, O_RDONLY | O_CLOEXEC);
+
+    if (sensor->fd < 0 || !read_value(sensor)) {
+        if (sensor->fd >= 0)
+            close(sensor->fd);
+        g_free(sensor->path);
+        g_free(sensor);
+        return NULL;
+    }
+    sensor->min = sensor->max = sensor->current_value;
+    sensor->core_power = g_strcmp0(raw, "SVI2_P_Core") == 0;
+
+    stem = g_strdup_printf("%s%d", kind->prefix, n);
+    resolve_label(sensor, title, stem, raw);
+    g_free(stem);
+
+    hint = sensor->hint;
+    sensor->hint = g_strdup_printf("%s\nSource: %s %s", hint, name, sensor->path);
+    g_free(hint);
+
+    // Enough to recreate the sensor without listing the directory again
+    sensor->manifest = g_strdup_printf("%s|%s|%s|%d|%s|%s", entry, name, file, node, title, raw ? raw : "");
+
+    return sensor;
+}
+
+static void free_sensor(HwmonSensor *sensor) {
+    close(sensor->fd);
+    g_free(sensor->path);
+    g_free(sensor->label);
+    g_free(sensor->hint);
+    g_free(sensor->manifest);
+    g_free(sensor);
+}
+
+static GSList* discover_device(const gchar *entry, const HwmonDriver *driver, const gchar *name,
+                               const gchar *title, gint node) {
+    GSList *list = NULL;
+    const HwmonKind *kind;
+    HwmonSensor *sensor;
+    GDir *dir;
+    const gchar *file;
+    gchar *path, *attr, *raw;
+    gint n;
+
+    path = g_strdup_printf(HWMON_DIR "/%s", entry);
+    dir = g_dir_open(path, 0, NULL);
+    g_free(path);
+    if (!dir)
+        return NULL;
+
+    while ((file = g_dir_read_name(dir))) {
+        kind = find_kind(file, &n);
+        if (!kind)
+            continue;
+
+        // amdgpu may offer both power1_input and power1_average
+        if (strcmp(kind->suffix, "_average") == 0) {
+            attr = g_strdup_printf(HWMON_DIR "/%s/%s%d_input", entry, kind->prefix, n);
+            if (g_file_test(attr, G_FILE_TEST_EXISTS)) {
+                g_free(attr);
+                continue;
+            }
+            g_free(attr);
+        }
+
+        attr = g_strdup_printf("%s%d_label", kind->prefix, n);
+        raw = read_attr(entry, attr);
+        sensor = new_sensor(entry, name, file, kind, n, driver->cpu ? node : -1, title, raw);
+        g_free(raw);
+        g_free(attr);
+
+        if (sensor)
+            list = g_slist_prepend(list, sensor);
+    }
+    g_dir_close(dir);
+
+    return g_slist_sort(list, compare_sensors);
+}
+
+// The PCI device of a CPU hwmon sits on its package's NUMA node. Without
+// NUMA information the devices are taken to be in package order.
+static gint device_package(const gchar *entry, gint fallback) {
+    gchar *numa;
+    gshort package = -1;
+
+    numa = read_attr(entry, "device/numa_node");
+    if (numa) {
+        package = get_numa_node_package(atoi(numa));
+        g_free(numa);
+    }
+
+    return package >= 0 ? package : fallback;
+}
+
+// hwmonN in numeric order, so devices keep their order across boots
+static gint compare_entries(gconstpointer a, gconstpointer b) {
+    const gchar *ea = *(const gchar**)a, *eb = *(const gchar**)b;
+
+    if (strlen(ea) != strlen(eb))
+        return strlen(ea) - strlen(eb);
+    return strcmp(ea, eb);
+}
+
+static GPtrArray* list_entries() {
+    GPtrArray *entries;
+    GDir *hwmon;
+    const gchar *entry;
+
+    entries = g_ptr_array_new_with_free_func(g_free);
+    hwmon = g_dir_open(HWMON_DIR, 0, NULL);
+    if (!hwmon)
+        return entries;
+
+    while ((entry = g_dir_read_name(hwmon)))
+        g_ptr_array_add(entries, g_strdup(entry));
+    g_dir_close(hwmon);
+    g_ptr_array_sort(entries, compare_entries);
+    return entries;
+}
+
+static void discover() {
+    const HwmonDriver *driver;
+    GPtrArray *entries;
+    GHashTable *seen;
+    const gchar *entry;
+    gchar *name, *title;
+    gint nodes = 0, count;
+    guint i;
+
+    entries = list_entries();
+    manifest_set_integer("hwmon", "devices", entries->len);
+
+    // Devices of the same driver after the first get a number
+    seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    for (i = 0; i < entries->len; i++) {
+        entry = g_ptr_array_index(entries, i);
+        name = read_attr(entry, "name");
+        driver = name ? match_driver(name) : NULL;
+        if (!driver) {
+            g_free(name);
+            continue;
+        }
+
+        count = GPOINTER_TO_INT(g_hash_table_lookup(seen, driver));
+        g_hash_table_insert(seen, (gpointer)driver, GINT_TO_POINTER(count + 1));
+        if (driver->cpu || count == 0)
+            title = g_strdup(driver->title);
+        else
+            title = g_strdup_printf("%s%d", driver->title, count);
+
+        hw_sensors = g_slist_concat(hw_sensors, discover_device(entry, driver, name, title,
+                                                                 driver->cpu ? device_package(entry, nodes) : -1));
+        if (driver->cpu)
+            nodes++;
+
+        g_free(title);
+        g_free(name);
+    }
+
+    g_hash_table_destroy(seen);
+    g_ptr_array_free(entries, TRUE);
+}
+
+// Drivers loaded or reloaded since the manifest was written add or renumber
+// hwmonN entries, so both the count and each device's name must still match
+static gboolean device_matches(const gchar *entry, const gchar *name, gchar **checked) {
+    gchar *current;
+    gboolean match;
+
+    // Sensors of one device are stored next to each other
+    if (g_strcmp0(*checked, entry) == 0)
+        return TRUE;
+
+    current = read_attr(entry, "name");
+    match = g_strcmp0(current, name) == 0;
+    g_free(current);
+
+    g_free(*checked);
+    *checked = match ? g_strdup(entry) : NULL;
+    return match;
+}
+
+// Entries are "hwmonN|name|file|node|title|label", in discovery order
+static gboolean load_manifest() {
+    const HwmonKind *kind;
+    HwmonSensor *sensor;
+    GPtrArray *entries;
+    gchar **list, **fields, *checked = NULL;
+    gsize len, i;
+    gint n, devices;
+
+    if (!manifest_get_integer("hwmon", "devices", &devices))
+        return FALSE;
+
+    entries = list_entries();
+    n = entries->len;
+    g_ptr_array_free(entries, TRUE);
+    if (n != devices)
+        return FALSE;
+
+    list = manifest_get_list("hwmon", "sensors", &len);
+    if (!list)
+        return FALSE;
+
+    for (i = 0; i < len; i++) {
+        fields = g_strsplit(list[i], "|", 6);
+        kind = g_strv_length(fields) == 6 && device_matches(fields[0], fields[1], &checked) ?
+               find_kind(fields[2], &n) : NULL;
+        sensor = kind ? new_sensor(fields[0], fields[1], fields[2], kind, n, atoi(fields[3]), fields[4],
+                                   *fields[5] ? fields[5] : NULL) : NULL;
+        g_strfreev(fields);
+
+        // A device went away or was renumbered, start over
+        if (!sensor) {
+            g_slist_free_full(hw_sensors, (GDestroyNotify)free_sensor);
+            hw_sensors = NULL;
+            break;
+        }
+        hw_sensors = g_slist_append(hw_sensors, sensor);
+    }
+
+    g_free(checked);
+    g_strfreev(list);
+    return hw_sensors != NULL;
+}
+
+static void store_manifest() {
+    const gchar **list;
+    GSList *node;
+    gsize len = 0;
+
+    list = g_new0(const gchar*, g_slist_length(hw_sensors) + 1);
+    for (node = hw_sensors; node; node = node->next)
+        list[len++] = ((HwmonSensor*)node->data)->manifest;
+
+    manifest_set_list("hwmon", "sensors", list, len);
+    g_free(list);
+}
+
+static gint cpu_nodes() {
+    GSList *node;
+    gint nodes = 0;
+
+    for (node = hw_sensors; node; node = node->next)
+        nodes = MAX(nodes, ((HwmonSensor*)node->data)->node + 1);
+    return nodes;
+}
+
+gboolean hwmon_init() {
+    if (!discovered) {
+        if (!load_manifest()) {
+            discover();
+            store_manifest();
+        }
+        discovered = TRUE;
+    }
+
+    return hw_sensors != NULL;
+}
+
+void hwmon_update() {
+    GSList *node;
+    HwmonSensor *sensor;
+
+    for (node = hw_sensors; node; node = node->next) {
+        sensor = (HwmonSensor *)node->data;
+
+        if (!sensor_needed(sensor->init))
+            continue;
+
+        if (read_value(sensor)) {
+            if (sensor->current_value < sensor->min)
+                sensor->min = sensor->current_value;
+
+            if (sensor->current_value > sensor->max)
+                sensor->max = sensor->current_value;
+        }
+        else{
+            sensor->current_value = ERROR_VALUE;
+        }
+    }
+}
+
+void hwmon_clear_minmax() {
+    HwmonSensor *sensor;
+    GSList *node;
+
+    for (node = hw_sensors; node; node = node->next) {
+        sensor = (HwmonSensor *)node->data;
+        sensor->min = sensor->current_value;
+        sensor->max = sensor->current_value;
+    }
+}
+
+GSList* hwmon_get_sensors() {
+    GSList *list = NULL;
+    HwmonSensor *sensor;
+    GSList *node;
+    SensorInit *data;
+    gint nodes = cpu_nodes();
+
+    for (node = hw_sensors; node; node = node->next) {
+        sensor = (HwmonSensor *)node->data;
+
+        data = sensor_init_new();
+        if (nodes > 1 && sensor->node >= 0){
+            data->label = g_strdup_printf("Node %d - %s", sensor->node, sensor->label);
+        }
+        else{
+            data->label = g_strdup(sensor->label);
+        }
+        data->hint = g_strdup(sensor->hint);
+        data->value = &sensor->current_value;
+        data->min = &sensor->min;
+        data->max = &sensor->max;
+        data->printf_format = sensor->kind->printf_format;
+        data->node = sensor->node;
+        data->aggregate = sensor->kind->aggregate;
+        sensor->init = data;
+        list = g_slist_append(list, data);
+    }
+
+    return list;
+}
+
+// SVI2 core power of one package, NULL if its driver does not report it
+SensorInit* hwmon_core_power_sensor(gint node) {
+    HwmonSensor *sensor;
+    GSList *list;
+
+    for (list = hw_sensors; list; list = list->next) {
+        sensor = list->data;
+        if (sensor->core_power && sensor->node == node)
+            return sensor->init;
+    }
+
+    return NULL;
+}
@@ -1,17 +1,23 @@
+#define _GNU_SOURCE
 #include <glib.h>
 #include <cpuid.h>
+#include <errno.h>
+#include <sched.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "zenmonitor.h"
 #include "msr.h"
 #include "sysfs.h"
+#include "manifest.h"
 
 #define MSR_PWR_PRINTF_FORMAT " %8.3f W"
 #define MSR_FID_PRINTF_FORMAT " %8.3f GHz"
+#define MSR_JITTER_PRINTF_FORMAT " %+7.3f ms"
 #define MESUREMENT_TIME 0.1
 
 // AMD PPR  = https://www.amd.com/system/files/TechDocs/54945_PPR_Family_17h_Models_00h-0Fh.pdf
@@ -23,14 +29,42 @@ static struct cpudev *cpu_dev_ids;
 
 static gint *msr_files = NULL;
 
-static gulong package_eng_b = 0;
-static gulong package_eng_a = 0;
+// One RAPL package counter per socket, read on the first core of it
+static guint packages = 0;
+static gint *package_core = NULL;
+
+static gulong *package_eng_b = NULL;
+static gulong *package_eng_a = NULL;
 static gulong *core_eng_b = NULL;
 static gulong *core_eng_a = NULL;
 
-gfloat package_power;
-gfloat package_power_min;
-gfloat package_power_max;
+// CLOCK_MONOTONIC_RAW of every energy read, in ns. Power is divided by the
+// time that really passed between the two reads of each counter, not by
+// the time that was asked for.
+static gint64 *package_time_b = NULL;
+static gint64 *package_time_a = NULL;
+static gint64 *core_time_b = NULL;
+static gint64 *core_time_a = NULL;
+
+// Handed out by msr_get_sensors, used to skip cores nobody observes
+static SensorInit **package_sensors = NULL;
+static gboolean *package_needed = NULL;
+static SensorInit **fid_sensors = NULL;
+static SensorInit **power_sensors = NULL;
+static gboolean *power_needed = NULL;
+static gboolean *fid_needed = NULL;
+static SensorInit *jitter_sensor = NULL;
+static SensorInit *fid_avg_sensor = NULL;
+
+gfloat *package_power;
+gfloat *package_power_min;
+gfloat *package_power_max;
+gfloat sample_jitter;
+gfloat sample_jitter_min;
+gfloat sample_jitter_max;
+gfloat fid_avg = ERROR_VALUE;
+gfloat fid_avg_min = ERROR_VALUE;
+gfloat fid_avg_max = ERROR_VALUE;
 gfloat *core_power;
 gfloat *core_fid;
 gfloat *core_power_min;
@@ -70,6 +104,34 @@ gulong get_package_energy() {
     return data;
 }
 
+static gint64 raw_time_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * G_GINT64_CONSTANT(1000000000) + ts.tv_nsec;
+}
+
+// The counter is latched somewhere inside the read, take the middle of it.
+// A failed read leaves time 0, which no window check accepts.
+static gulong read_energy(gint core, guint index, gint64 *time) {
+    gint64 start = raw_time_ns();
+    gulong data;
+
+    if (!read_msr(msr_files[core], index, &data)) {
+        *time = 0;
+        return 0;
+    }
+
+    *time = (start + raw_time_ns()) / 2;
+    return data;
+}
+
+// The energy status counters are 32 bits wide (AMD PPR: MSRC001_029A/B
+// [31:0]) and wrap within minutes at full load
+static gulong energy_delta(gulong after, gulong before) {
+    return (after - before) & 0xFFFFFFFFUL;
+}
+
 gulong get_core_energy(gint core) {
     gulong data;
     // AMD OSRR: page 139 - MSRC001_029A
@@ -99,7 +161,218 @@ gdouble get_core_fid(gint core) {
     return ratio * 200.0 / 1000.0;
 }
 
+gulong get_core_aperf(gint core) {
+    gulong data;
+    // AMD PPR: MSR0000_00E8 - Actual Performance Frequency Clock Count
+    if (!read_msr(msr_files[core], 0xE8, &data))
+        return 0;
+
+    return data;
+}
+
+gulong get_core_mperf(gint core) {
+    gulong data;
+    // AMD PPR: MSR0000_00E7 - Max Performance Frequency Clock Count
+    if (!read_msr(msr_files[core], 0xE7, &data))
+        return 0;
+
+    return data;
+}
+
+// Reading a core's MSR from another CPU is an IPI to that core, wherever
+// the reader runs. What costs time is doing them one after another: one
+// worker per CCX reads that CCX's cores while the others read theirs, and
+// all of them meet again at a barrier. Each worker is pinned to a CPU of
+// its CCX so the pool does not pile up on one CPU.
+typedef enum {
+    MSR_READ_BEFORE,            // energy at the start of the window
+    MSR_READ_AFTER              // energy at the end, and FID
+} MsrPhase;
+
+typedef struct {
+    gint cpu;                   // the worker is pinned here
+    GArray *cores;              // guint, indices into cpu_dev_ids
+    GThread *thread;
+    gboolean pinned;
+} MsrWorker;
+
+static GPtrArray *workers = NULL;
+static gboolean use_workers = TRUE;
+static GMutex pool_lock;
+static GCond pool_start;
+static GCond pool_done;
+static guint pool_generation = 0;
+static guint pool_pending = 0;
+static gboolean pool_stop = FALSE;
+static MsrPhase pool_phase;
+
+static void read_core(guint i, MsrPhase phase) {
+    if (phase == MSR_READ_BEFORE) {
+        if (power_needed[i])
+            core_eng_b[i] = read_energy(i, 0xC001029A, &core_time_b[i]);
+        return;
+    }
+
+    if (power_needed[i])
+        core_eng_a[i] = read_energy(i, 0xC001029A, &core_time_a[i]);
+    if (fid_needed[i])
+        core_fid[i] = get_core_fid(i);
+}
+
+static gpointer worker_thread(gpointer data) {
+    MsrWorker *w = data;
+    cpu_set_t set;
+    MsrPhase phase;
+    guint seen = 0, i;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+        g_printerr("msr: cannot pin worker to CPU %d: %s\n", w->cpu, g_strerror(errno));
+    else
+        w->pinned = TRUE;
+
+    // Tell start_workers whether pinning worked before taking any work
+    g_mutex_lock(&pool_lock);
+    if (--pool_pending == 0)
+        g_cond_signal(&pool_done);
+
+    for (;;) {
+        while (pool_generation == seen && !pool_stop)
+            g_cond_wait(&pool_start, &pool_lock);
+        if (pool_stop)
+            break;
+        seen = pool_generation;
+        phase = pool_phase;
+        g_mutex_unlock(&pool_lock);
+
+        for (i = 0; i < w->cores->len; i++)
+            read_core(g_array_index(w->cores, guint, i), phase);
+
+        g_mutex_lock(&pool_lock);
+        if (--pool_pending == 0)
+            g_cond_signal(&pool_done);
+    }
+    g_mutex_unlock(&pool_lock);
+
+    return NULL;
+}
+
+static void free_worker(gpointer data) {
+    MsrWorker *w = data;
+
+    g_array_free(w->cores, TRUE);
+    g_free(w);
+}
+
+static void stop_workers() {
+    MsrWorker *w;
+    guint j;
+
+    if (!workers)
+        return;
+
+    g_mutex_lock(&pool_lock);
+    pool_stop = TRUE;
+    g_cond_broadcast(&pool_start);
+    g_mutex_unlock(&pool_lock);
+
+    for (j = 0; j < workers->len; j++) {
+        w = g_ptr_array_index(workers, j);
+        if (w->thread)
+            g_thread_join(w->thread);
+    }
+
+    g_ptr_array_free(workers, TRUE);
+    workers = NULL;
+}
+
+static void start_workers() {
+    MsrWorker *w;
+    gboolean pinned = TRUE;
+    guint i, j;
+
+    workers = g_ptr_array_new_with_free_func(free_worker);
+    for (i = 0; i < cores; i++) {
+        w = NULL;
+        for (j = 0; j < workers->len; j++) {
+            w = g_ptr_array_index(workers, j);
+            if (cpu_dev_ids[g_array_index(w->cores, guint, 0)].ccx == cpu_dev_ids[i].ccx)
+                break;
+            w = NULL;
+        }
+
+        if (!w) {
+            w = g_new0(MsrWorker, 1);
+            w->cpu = cpu_dev_ids[i].cpuid;
+            w->cores = g_array_new(FALSE, FALSE, sizeof(guint));
+            g_ptr_array_add(workers, w);
+        }
+        g_array_append_val(w->cores, i);
+    }
+
+    // A single CCX gains nothing from handing the work to another thread
+    if (workers->len < 2) {
+        g_ptr_array_free(workers, TRUE);
+        workers = NULL;
+        return;
+    }
+
+    g_mutex_lock(&pool_lock);
+    pool_pending = workers->len;
+    for (j = 0; j < workers->len; j++) {
+        w = g_ptr_array_index(workers, j);
+        w->thread = g_thread_new("zm-msr", worker_thread, w);
+    }
+    while (pool_pending > 0)
+        g_cond_wait(&pool_done, &pool_lock);
+    g_mutex_unlock(&pool_lock);
+
+    for (j = 0; j < workers->len; j++)
+        pinned &= ((MsrWorker*)g_ptr_array_index(workers, j))->pinned;
+
+    // Unpinned workers may all share one CPU, the serial loop is no worse
+    if (!pinned) {
+        g_printerr("msr: reading cores inline\n");
+        stop_workers();
+        return;
+    }
+
+    atexit(stop_workers);
+}
+
+static void read_cores(MsrPhase phase) {
+    guint i;
+
+    if (!workers || !use_workers) {
+        for (i = 0; i < cores; i++)
+            read_core(i, phase);
+        return;
+    }
+
+    g_mutex_lock(&pool_lock);
+    pool_phase = phase;
+    pool_pending = workers->len;
+    pool_generation++;
+    g_cond_broadcast(&pool_start);
+    while (pool_pending > 0)
+        g_cond_wait(&pool_done, &pool_lock);
+    g_mutex_unlock(&pool_lock);
+}
+
+// access() checks the real uid and ignores file capabilities, only an
+// open tells whether this process can read the MSRs
+static gboolean msr_readable() {
+    gint fd = open("/dev/cpu/0/msr", O_RDONLY);
+
+    if (fd < 0)
+        return FALSE;
+    close(fd);
+    return TRUE;
+}
+
 gboolean msr_init() {
+    gboolean available;
     guint i;
 
     if (!check_zen())
@@ -109,6 +382,10 @@ gboolean msr_init() {
     if (cores == 0)
         return FALSE;
 
+    // Not readable last time, do not open every core again unless the msr module showed up
+    if (manifest_get_boolean("msr", "available", &available) && !available && !msr_readable())
+        return FALSE;
+
     cpu_dev_ids = get_cpu_dev_ids();
     msr_files = malloc(cores * sizeof (gint));
     for (i = 0; i < cores; i++) {
@@ -116,11 +393,39 @@ gboolean msr_init() {
     }
 
     energy_unit = get_energy_unit();
+    manifest_set_boolean("msr", "available", energy_unit != 0);
     if (energy_unit == 0)
         return FALSE;
 
+    for (i = 0; i < cores; i++)
+        packages = MAX(packages, (guint)MAX(cpu_dev_ids[i].node, 0) + 1);
+
+    package_core = g_new(gint, packages);
+    for (i = 0; i < packages; i++)
+        package_core[i] = -1;
+    for (i = 0; i < cores; i++) {
+        if (package_core[MAX(cpu_dev_ids[i].node, 0)] < 0)
+            package_core[MAX(cpu_dev_ids[i].node, 0)] = i;
+    }
+
+    package_sensors = g_new0(SensorInit*, packages);
+    package_needed = g_new0(gboolean, packages);
+    package_eng_b = g_new0(gulong, packages);
+    package_eng_a = g_new0(gulong, packages);
+    package_time_b = g_new0(gint64, packages);
+    package_time_a = g_new0(gint64, packages);
+    package_power = g_new0(gfloat, packages);
+    package_power_min = g_new0(gfloat, packages);
+    package_power_max = g_new0(gfloat, packages);
+
+    fid_sensors = g_new0(SensorInit*, cores);
+    power_sensors = g_new0(SensorInit*, cores);
+    power_needed = g_new0(gboolean, cores);
+    fid_needed = g_new0(gboolean, cores);
     core_eng_b = malloc(cores * sizeof (gulong));
     core_eng_a = malloc(cores * sizeof (gulong));
+    core_time_b = malloc(cores * sizeof (gint64));
+    core_time_a = malloc(cores * sizeof (gint64));
     core_power = malloc(cores * sizeof (gfloat));
     core_fid = malloc(cores * sizeof (gfloat));
     core_power_min = malloc(cores * sizeof (gfloat));
@@ -128,44 +433,80 @@ gboolean msr_init() {
     core_fid_min = malloc(cores * sizeof (gfloat));
     core_fid_max = malloc(cores * sizeof (gfloat));
 
+    start_workers();
     msr_update();
     memcpy(core_power_min, core_power, cores * sizeof (gfloat));
     memcpy(core_power_max, core_power, cores * sizeof (gfloat));
     memcpy(core_fid_min, core_fid, cores * sizeof (gfloat));
     memcpy(core_fid_max, core_fid, cores * sizeof (gfloat));
-    package_power_min = package_power;
-    package_power_max = package_power;
+    memcpy(package_power_min, package_power, packages * sizeof (gfloat));
+    memcpy(package_power_max, package_power, packages * sizeof (gfloat));
+    sample_jitter_min = sample_jitter;
+    sample_jitter_max = sample_jitter;
 
     return TRUE;
 }
 
 void msr_update() {
-    guint i;
+    gboolean any_power = FALSE, any_fid = FALSE, avg_needed, jitter_needed;
+    gdouble fid_sum = 0;
+    gint64 sleep_start = 0, sleep_end = 0;
+    guint i, fid_count = 0;
+
+    for (i = 0; i < packages; i++) {
+        package_needed[i] = package_core[i] >= 0 && sensor_needed(package_sensors[i]);
+        any_power |= package_needed[i];
+    }
+    // The jitter is a property of the sleep, it needs no counter of its own
+    jitter_needed = sensor_needed(jitter_sensor);
+    any_power |= jitter_needed;
 
-    package_eng_b = get_package_energy();
     for (i = 0; i < cores; i++) {
-        core_eng_b[i] = get_core_energy(i);
+        power_needed[i] = sensor_needed(power_sensors[i]);
+        fid_needed[i] = sensor_needed(fid_sensors[i]);
+        any_power |= power_needed[i];
+        any_fid |= fid_needed[i];
     }
 
-    usleep(MESUREMENT_TIME*1000000);
+    // Energy counters need two reads and the sleep in between, skip all of
+    // it when no power sensor is observed
+    if (any_power) {
+        for (i = 0; i < packages; i++) {
+            if (package_needed[i])
+                package_eng_b[i] = read_energy(package_core[i], 0xC001029B, &package_time_b[i]);
+        }
+        read_cores(MSR_READ_BEFORE);
 
-    package_eng_a = get_package_energy();
-    for (i = 0; i < cores; i++) {
-        core_eng_a[i] = get_core_energy(i);
+        sleep_start = raw_time_ns();
+        usleep(MESUREMENT_TIME*1000000);
+        sleep_end = raw_time_ns();
+
+        for (i = 0; i < packages; i++) {
+            if (package_needed[i])
+                package_eng_a[i] = read_energy(package_core[i], 0xC001029B, &package_time_a[i]);
+        }
     }
 
-    if (package_eng_a >= package_eng_b) {
-        package_power = (package_eng_a - package_eng_b) * energy_unit / MESUREMENT_TIME;
+    if (any_power || any_fid)
+        read_cores(MSR_READ_AFTER);
+
+    for (i = 0; i < packages; i++) {
+        if (!package_needed[i] || package_time_b[i] == 0 || package_time_a[i] <= package_time_b[i])
+            continue;
 
-        if (package_power < package_power_min)
-            package_power_min = package_power;
-        if (package_power > package_power_max)
-            package_power_max = package_power;
+        package_power[i] = energy_delta(package_eng_a[i], package_eng_b[i]) * energy_unit /
+                           ((package_time_a[i] - package_time_b[i]) / 1e9);
+
+        if (package_power[i] < package_power_min[i])
+            package_power_min[i] = package_power[i];
+        if (package_power[i] > package_power_max[i])
+            package_power_max[i] = package_power[i];
     }
 
     for (i = 0; i < cores; i++) {
-        if (core_eng_a[i] >= core_eng_b[i]) {
-            core_power[i] = (core_eng_a[i] - core_eng_b[i]) * energy_unit / MESUREMENT_TIME;
+        if (power_needed[i] && core_time_b[i] != 0 && core_time_a[i] > core_time_b[i]) {
+            core_power[i] = energy_delta(core_eng_a[i], core_eng_b[i]) * energy_unit /
+                            ((core_time_a[i] - core_time_b[i]) / 1e9);
 
             if (core_power[i] < core_power_min[i])
                 core_power_min[i] = core_power[i];
@@ -173,20 +514,158 @@ void msr_update() {
                 core_power_max[i] = core_power[i];
         }
 
-        core_fid[i] = get_core_fid(i);
+        if (!fid_needed[i])
+            continue;
+
+        if (core_fid[i] > 0) {
+            fid_sum += core_fid[i];
+            fid_count++;
+        }
 
         if (core_fid[i] < core_fid_min[i])
             core_fid_min[i] = core_fid[i];
         if (core_fid[i] > core_fid_max[i])
             core_fid_max[i] = core_fid[i];
     }
+
+    // Observing the average observes every core, so the sum covers them all
+    avg_needed = sensor_needed(fid_avg_sensor);
+    if (avg_needed && fid_count > 0) {
+        fid_avg = fid_sum / fid_count;
+
+        if (fid_avg_min == ERROR_VALUE || fid_avg < fid_avg_min)
+            fid_avg_min = fid_avg;
+        if (fid_avg_max == ERROR_VALUE || fid_avg > fid_avg_max)
+            fid_avg_max = fid_avg;
+    }
+    else if (avg_needed) {
+        fid_avg = ERROR_VALUE;
+    }
+
+    // How far the sleep between the two reads overshot the requested time.
+    // The reads around it are not counted, power uses each counter's own
+    // read times and does not depend on how long they take.
+    if (jitter_needed && sleep_end > sleep_start) {
+        sample_jitter = (sleep_end - sleep_start) / 1e6 - MESUREMENT_TIME * 1000;
+
+        if (sample_jitter < sample_jitter_min)
+            sample_jitter_min = sample_jitter;
+        if (sample_jitter > sample_jitter_max)
+            sample_jitter_max = sample_jitter;
+    }
+}
+
+static gint compare_times(const void *a, const void *b) {
+    gint64 x = *(const gint64*)a, y = *(const gint64*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void bench_report(const gchar *name, gint64 *wall, gint64 *skew, guint ticks) {
+    qsort(wall, ticks, sizeof *wall, compare_times);
+    qsort(skew, ticks, sizeof *skew, compare_times);
+
+    g_print("%-7s latency median %8.1f us  p99 %8.1f us    skew median %8.1f us  p99 %8.1f us\n", name,
+            wall[ticks / 2] / 1e3, wall[ticks * 99 / 100] / 1e3,
+            skew[ticks / 2] / 1e3, skew[ticks * 99 / 100] / 1e3);
+}
+
+// Reads every core's energy and FID the way msr_update does, once with the
+// serial loop and once with the worker pool. Latency is the wall time of
+// one pass, skew the spread of the energy read times across cores.
+gboolean msr_bench(guint ticks) {
+    gint64 *wall, *skew, start, lo, hi;
+    guint mode, t, i;
+
+    if (!msr_init()) {
+        g_printerr("msr-bench: MSR access is not available\n");
+        return FALSE;
+    }
+
+    if (!workers)
+        g_print("msr-bench: single CCX or workers not pinned, the worker pool is not used\n");
+    g_print("msr-bench: %u cores, %u passes each\n", cores, ticks);
+
+    for (i = 0; i < cores; i++)
+        power_needed[i] = fid_needed[i] = TRUE;
+
+    wall = g_new(gint64, ticks);
+    skew = g_new(gint64, ticks);
+
+    for (mode = 0; mode < 2; mode++) {
+        use_workers = mode == 1;
+
+        for (t = 0; t < ticks; t++) {
+            start = raw_time_ns();
+            read_cores(MSR_READ_AFTER);
+            wall[t] = raw_time_ns() - start;
+
+            lo = hi = core_time_a[0];
+            for (i = 1; i < cores; i++) {
+                lo = MIN(lo, core_time_a[i]);
+                hi = MAX(hi, core_time_a[i]);
+            }
+            skew[t] = hi - lo;
+
+            // Let the workers go back to sleep, as they do between ticks
+            usleep(10000);
+        }
+
+        bench_report(mode ? "pool" : "serial", wall, skew, ticks);
+    }
+
+    use_workers = TRUE;
+    g_free(wall);
+    g_free(skew);
+    return TRUE;
+}
+
+// Process power attribution needs every core's power, observed or not
+void msr_observe_core_power(gboolean observe) {
+    guint i;
+
+    for (i = 0; i < cores && power_sensors; i++) {
+        if (!power_sensors[i])
+            continue;
+        if (observe)
+            sensor_observe(power_sensors[i]);
+        else
+            sensor_unobserve(power_sensors[i]);
+    }
+}
+
+// For sources computed from msr readings, valid once msr_get_sensors ran
+guint msr_node_count() {
+    return power_sensors ? packages : 0;
+}
+
+SensorInit* msr_package_sensor(guint node) {
+    return node < msr_node_count() ? package_sensors[node] : NULL;
+}
+
+// RAPL core power sensors of the node, free the array only
+GPtrArray* msr_core_power_sensors(guint node) {
+    GPtrArray *list = g_ptr_array_new();
+    guint i;
+
+    for (i = 0; i < cores && power_sensors; i++) {
+        if (power_sensors[i] && (guint)MAX(cpu_dev_ids[i].node, 0) == node)
+            g_ptr_array_add(list, power_sensors[i]);
+    }
+    return list;
 }
 
 void msr_clear_minmax() {
     guint i;
 
-    package_power_min = package_power;
-    package_power_max = package_power;
+    sample_jitter_min = sample_jitter;
+    sample_jitter_max = sample_jitter;
+    fid_avg_min = fid_avg;
+    fid_avg_max = fid_avg;
+    for (i = 0; i < packages; i++) {
+        package_power_min[i] = package_power[i];
+        package_power_max[i] = package_power[i];
+    }
     for (i = 0; i < cores; i++) {
         core_power_min[i] = core_power[i];
         core_power_max[i] = core_power[i];
@@ -200,13 +679,35 @@ GSList* msr_get_sensors() {
     SensorInit *data;
     guint i;
 
+    for (i = 0; i < packages; i++) {
+        if (package_core[i] < 0)
+            continue;
+
+        data = sensor_init_new();
+        if (packages > 1)
+            data->label = g_strdup_printf("Node %d - Package Power", i);
+        else
+            data->label = g_strdup("Package Power");
+        data->hint = g_strdup_printf("Package Power reported by RAPL\nSource: cpu%d MSR", cpu_dev_ids[package_core[i]].cpuid);
+        data->value = &package_power[i];
+        data->min = &package_power_min[i];
+        data->max = &package_power_max[i];
+        data->printf_format = MSR_PWR_PRINTF_FORMAT;
+        data->node = i;
+        package_sensors[i] = data;
+        list = g_slist_append(list, data);
+    }
+
     data = sensor_init_new();
-    data->label = g_strdup("Package Power");
-    data->hint = g_strdup("Package Power reported by RAPL\nSource: cpu0 MSR");
-    data->value = &package_power;
-    data->min = &package_power_min;
-    data->max = &package_power_max;
-    data->printf_format = MSR_PWR_PRINTF_FORMAT;
+    data->label = g_strdup("Power Sample Jitter");
+    data->hint = g_strdup_printf("Measured minus requested (%.0f ms) sleep between the energy reads\n"
+                                 "Power is computed from the measured interval\nSource: CLOCK_MONOTONIC_RAW",
+                                 MESUREMENT_TIME * 1000);
+    data->value = &sample_jitter;
+    data->min = &sample_jitter_min;
+    data->max = &sample_jitter_max;
+    data->printf_format = MSR_JITTER_PRINTF_FORMAT;
+    jitter_sensor = data;
     list = g_slist_append(list, data);
 
     for (i = 0; i < cores; i++) {
@@ -217,9 +718,26 @@ GSList* msr_get_sensors() {
         data->min = &(core_fid_min[i]);
         data->max = &(core_fid_max[i]);
         data->printf_format = MSR_FID_PRINTF_FORMAT;
+        data->node = cpu_dev_ids[i].node;
+        data->ccx = cpu_dev_ids[i].ccx;
+        data->core = display_coreid ? cpu_dev_ids[i].coreid: i;
+        data->aggregate = SENSOR_AGG_AVG;
+        fid_sensors[i] = data;
         list = g_slist_append(list, data);
     }
 
+    data = sensor_init_new();
+    data->label = g_strdup("Average Effective Frequency");
+    data->hint = g_strdup("Mean Effective Frequency of all cores");
+    data->value = &fid_avg;
+    data->min = &fid_avg_min;
+    data->max = &fid_avg_max;
+    data->printf_format = MSR_FID_PRINTF_FORMAT;
+    for (i = 0; i < cores; i++)
+        data->deps = g_slist_prepend(data->deps, fid_sensors[i]);
+    fid_avg_sensor = data;
+    list = g_slist_append(list, data);
+
     for (i = 0; i < cores; i++) {
         data = sensor_init_new();
         data->label = g_strdup_printf("Core %d Power", display_coreid ? cpu_dev_ids[i].coreid: i);
@@ -228,6 +746,11 @@ GSList* msr_get_sensors() {
         data->min = &(core_power_min[i]);
         data->max = &(core_power_max[i]);
         data->printf_format = MSR_PWR_PRINTF_FORMAT;
+        data->node = cpu_dev_ids[i].node;
+        data->ccx = cpu_dev_ids[i].ccx;
+        data->core = display_coreid ? cpu_dev_ids[i].coreid: i;
+        data->aggregate = SENSOR_AGG_SUM;
+        power_sensors[i] = data;
         list = g_slist_append(list, data);
     }
 
@@ -10,6 +10,7 @@
 static gchar **frq_files = NULL;
 static guint cores;
 static struct cpudev *cpu_dev_ids;
+static SensorInit **freq_sensors = NULL;
 
 gfloat *core_freq;
 gfloat *core_freq_min;
@@ -46,6 +47,7 @@ gboolean os_init(void) {
                         cpu_dev_ids[i].cpuid);
     }
 
+    freq_sensors = g_new0(SensorInit*, cores);
     core_freq = malloc(cores * sizeof (gfloat));
     core_freq_min = malloc(cores * sizeof (gfloat));
     core_freq_max = malloc(cores * sizeof (gfloat));
@@ -61,6 +63,9 @@ void os_update(void) {
     guint i;
 
     for (i = 0; i < cores; i++) {
+        if (!sensor_needed(freq_sensors[i]))
+            continue;
+
         core_freq[i] = get_frequency(i);
         if (core_freq[i] < core_freq_min[i])
             core_freq_min[i] = core_freq[i];
@@ -91,6 +96,11 @@ GSList* os_get_sensors(void) {
         data->min = &(core_freq_min[i]);
         data->max = &(core_freq_max[i]);
         data->printf_format = OS_FREQ_PRINTF_FORMAT;
+        data->node = cpu_dev_ids[i].node;
+        data->ccx = cpu_dev_ids[i].ccx;
+        data->core = display_coreid ? cpu_dev_ids[i].coreid: i;
+        data->aggregate = SENSOR_AGG_AVG;
+        freq_sensors[i] = data;
         list = g_slist_append(list, data);
     }
 
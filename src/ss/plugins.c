@@ -0,0 +1,280 @@
+#include <glib.h>
+#include <dlfcn.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+#include <sys/stat.h>
+#include "zenmonitor.h"
+#include "zenmonitor-plugin.h"
+#include "plugins.h"
+
+#ifndef ZM_PLUGIN_DIR
+#define ZM_PLUGIN_DIR "/usr/local/lib/zenmonitor/plugins"
+#endif
+
+typedef struct {
+    void *handle;
+    const ZmPlugin *plugin;
+    const ZmPluginSensor *table;
+    gchar *path;
+    guint offset;               // first value in the frame
+    guint count;
+} Plugin;
+
+static gchar **plugin_files = NULL;
+static GPtrArray *plugins = NULL;
+
+// All plugins share one frame, each writes its own slice of it
+static guint frame_len = 0;
+static gfloat *frame = NULL;
+static gfloat *frame_min = NULL;
+static gfloat *frame_max = NULL;
+static guchar *wanted = NULL;
+static SensorInit **frame_sensors = NULL;
+
+void plugins_set_files(gchar **files) {
+    plugin_files = files;
+}
+
+// Any effective capability of a non-root user, from /proc/self/status
+static gboolean has_capabilities() {
+    gchar *status = NULL, *p;
+    gboolean caps = FALSE;
+
+    if (!g_file_get_contents("/proc/self/status", &status, NULL, NULL))
+        return TRUE;
+
+    p = strstr(status, "\nCapEff:");
+    caps = !p || g_ascii_strtoull(p + 8, NULL, 16) != 0;
+    g_free(status);
+    return caps;
+}
+
+// setuid, setgid or file capabilities: the invoking user must not be able to
+// run code with more rights than their own, the same reason glibc ignores
+// LD_PRELOAD here
+static gboolean privileged() {
+    return getauxval(AT_SECURE) || geteuid() != getuid() || getegid() != getgid() ||
+           (getuid() != 0 && has_capabilities());
+}
+
+// Owned by root, or by the real user when that gives no extra rights, and
+// writable by nobody else
+static gboolean trusted_path(const gchar *path, gboolean priv) {
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+        return FALSE;
+
+    if (st.st_uid != 0 && (priv || st.st_uid != getuid()))
+        return FALSE;
+    return !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+static void load_plugin(const gchar *path) {
+    const ZmPluginSensor *table = NULL;
+    const ZmPlugin *plugin;
+    ZmPluginEntry entry;
+    Plugin *p;
+    void *handle;
+    gint count;
+
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        g_printerr("plugins: %s\n", dlerror());
+        return;
+    }
+
+    entry = (ZmPluginEntry)dlsym(handle, ZM_PLUGIN_ENTRY);
+    plugin = entry ? entry() : NULL;
+    if (!plugin || plugin->abi_version != ZM_PLUGIN_ABI_VERSION || !plugin->init || !plugin->update) {
+        g_printerr("plugins: %s is not a plugin for ABI version %d\n", path, ZM_PLUGIN_ABI_VERSION);
+        dlclose(handle);
+        return;
+    }
+
+    count = plugin->init(&table);
+    if (count <= 0 || !table) {
+        if (plugin->shutdown)
+            plugin->shutdown();
+        dlclose(handle);
+        return;
+    }
+
+    p = g_new0(Plugin, 1);
+    p->handle = handle;
+    p->plugin = plugin;
+    p->table = table;
+    p->path = g_strdup(path);
+    p->offset = frame_len;
+    p->count = count;
+    frame_len += count;
+    g_ptr_array_add(plugins, p);
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b) {
+    return strcmp(*(const gchar**)a, *(const gchar**)b);
+}
+
+// *.so in name order, so sensors keep their order between runs
+static void load_dir(const gchar *path, gboolean priv) {
+    GPtrArray *names;
+    GDir *dir;
+    const gchar *name;
+    gchar *file;
+    guint i;
+
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR))
+        return;
+    if (!trusted_path(path, priv)) {
+        g_printerr("plugins: %s is writable by other users, not loading plugins from it\n", path);
+        return;
+    }
+
+    dir = g_dir_open(path, 0, NULL);
+    if (!dir)
+        return;
+
+    names = g_ptr_array_new_with_free_func(g_free);
+    while ((name = g_dir_read_name(dir))) {
+        if (g_str_has_suffix(name, ".so"))
+            g_ptr_array_add(names, g_strdup(name));
+    }
+    g_dir_close(dir);
+    g_ptr_array_sort(names, compare_names);
+
+    for (i = 0; i < names->len; i++) {
+        file = g_build_filename(path, g_ptr_array_index(names, i), NULL);
+        if (trusted_path(file, priv))
+            load_plugin(file);
+        else
+            g_printerr("plugins: %s is writable by other users, not loaded\n", file);
+        g_free(file);
+    }
+    g_ptr_array_free(names, TRUE);
+}
+
+static void plugins_shutdown() {
+    Plugin *p;
+    guint i;
+
+    for (i = 0; i < plugins->len; i++) {
+        p = g_ptr_array_index(plugins, i);
+        if (p->plugin->shutdown)
+            p->plugin->shutdown();
+    }
+}
+
+gboolean plugins_init() {
+    gboolean priv;
+    guint i;
+
+    if (plugins)
+        return frame_len > 0;
+
+    plugins = g_ptr_array_new();
+    priv = privileged();
+    if (priv && plugin_files && plugin_files[0])
+        g_printerr("plugins: running with elevated privileges, --plugin is ignored\n");
+    for (i = 0; !priv && plugin_files && plugin_files[i]; i++)
+        load_plugin(plugin_files[i]);
+    load_dir(ZM_PLUGIN_DIR, priv);
+
+    if (frame_len == 0)
+        return FALSE;
+
+    frame = g_new(gfloat, frame_len);
+    frame_min = g_new(gfloat, frame_len);
+    frame_max = g_new(gfloat, frame_len);
+    wanted = g_new(guchar, frame_len);
+    frame_sensors = g_new0(SensorInit*, frame_len);
+    for (i = 0; i < frame_len; i++)
+        frame[i] = frame_min[i] = frame_max[i] = ERROR_VALUE;
+
+    atexit(plugins_shutdown);
+
+    plugins_update();
+    return TRUE;
+}
+
+// One batch call per plugin, and none at all when nobody looks at its sensors
+void plugins_update() {
+    gboolean any;
+    Plugin *p;
+    guint i, j;
+
+    for (i = 0; i < plugins->len; i++) {
+        p = g_ptr_array_index(plugins, i);
+
+        any = FALSE;
+        for (j = p->offset; j < p->offset + p->count; j++) {
+            wanted[j] = sensor_needed(frame_sensors[j]);
+            any |= wanted[j];
+        }
+        if (!any)
+            continue;
+
+        p->plugin->update(frame + p->offset, wanted + p->offset, p->count);
+
+        for (j = p->offset; j < p->offset + p->count; j++) {
+            if (!wanted[j])
+                continue;
+
+            if (isnan(frame[j])) {
+                frame[j] = ERROR_VALUE;
+                continue;
+            }
+
+            if (frame_min[j] == ERROR_VALUE || frame[j] < frame_min[j])
+                frame_min[j] = frame[j];
+            if (frame_max[j] == ERROR_VALUE || frame[j] > frame_max[j])
+                frame_max[j] = frame[j];
+        }
+    }
+}
+
+void plugins_clear_minmax() {
+    guint i;
+
+    for (i = 0; i < frame_len; i++)
+        frame_min[i] = frame_max[i] = frame[i];
+}
+
+GSList* plugins_get_sensors() {
+    const ZmPluginSensor *def;
+    GSList *list = NULL;
+    SensorInit *data;
+    Plugin *p;
+    guint i, j;
+
+    for (i = 0; i < plugins->len; i++) {
+        p = g_ptr_array_index(plugins, i);
+
+        for (j = 0; j < p->count; j++) {
+            def = &p->table[j];
+
+            data = sensor_init_new();
+            data->label = g_strdup(def->label);
+            if (def->hint)
+                data->hint = g_strdup_printf("%s\nSource: %s plugin %s", def->hint, p->plugin->name, p->path);
+            else
+                data->hint = g_strdup_printf("Source: %s plugin %s", p->plugin->name, p->path);
+            data->value = &frame[p->offset + j];
+            data->min = &frame_min[p->offset + j];
+            data->max = &frame_max[p->offset + j];
+            data->printf_format = def->printf_format;
+            data->node = def->node;
+            data->ccx = def->ccx;
+            data->core = def->core;
+            if (def->aggregate >= ZM_PLUGIN_AGG_NONE && def->aggregate <= ZM_PLUGIN_AGG_MAX)
+                data->aggregate = (SensorAggregate)def->aggregate;
+
+            frame_sensors[p->offset + j] = data;
+            list = g_slist_append(list, data);
+        }
+    }
+
+    return list;
+}
@@ -0,0 +1,257 @@
+#define _GNU_SOURCE
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "zenmonitor.h"
+#include "remote.h"
+
+// Sensor source that mirrors every sensor of a "zenmonitor --server"
+// instance, so the client itself never touches the hardware.
+
+typedef struct {
+    gchar *label;
+    gchar *hint;
+    gchar *printf_format;
+    RemoteTopology topology;
+} RemoteSensor;
+
+static gchar *socket_path = NULL;
+static gint sock = -1;
+static guint sensor_count = 0;
+static RemoteSensor *remote_sensors = NULL;
+static guint8 *msg = NULL;
+static gsize msg_size = 0;
+
+// The server's Min/Max are shared by all its clients, after a clear this
+// client tracks its own from the values of every frame it receives
+static gboolean local_minmax = FALSE;
+
+static SensorInit **remote_inits = NULL;
+
+gfloat *remote_value;
+gfloat *remote_min;
+gfloat *remote_max;
+
+static gchar *get_str(const guint8 **p, const guint8 *end) {
+    guint16 len;
+    gchar *s;
+
+    if (end - *p < sizeof len)
+        return NULL;
+    memcpy(&len, *p, sizeof len);
+    *p += sizeof len;
+
+    if (end - *p < len)
+        return NULL;
+    s = g_strndup((const gchar*)*p, len);
+    *p += len;
+    return s;
+}
+
+static gssize recv_msg(gint flags) {
+    gssize len;
+
+    // Peek at the size first, a frame never gets truncated
+    len = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC | flags);
+    if (len <= 0)
+        return len;
+
+    if (len > msg_size) {
+        msg_size = len;
+        msg = g_realloc(msg, msg_size);
+    }
+    return recv(sock, msg, msg_size, flags);
+}
+
+static void free_remote_sensors() {
+    guint i;
+
+    for (i = 0; remote_sensors && i < sensor_count; i++) {
+        g_free(remote_sensors[i].label);
+        g_free(remote_sensors[i].hint);
+        g_free(remote_sensors[i].printf_format);
+    }
+    g_free(remote_sensors);
+    remote_sensors = NULL;
+    sensor_count = 0;
+}
+
+// Only a server run by root or by this user is trusted, anyone else could
+// have bound the socket path
+static gboolean server_trusted() {
+    struct ucred cred;
+    socklen_t len = sizeof cred;
+
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+        return FALSE;
+    return cred.uid == 0 || cred.uid == getuid();
+}
+
+static gboolean read_hello() {
+    const RemoteHello *h;
+    const guint8 *p, *end;
+    gchar *source, *hint;
+    gssize len;
+    guint i;
+
+    len = recv_msg(0);
+    if (len < (gssize)sizeof(RemoteHello))
+        return FALSE;
+
+    h = (const RemoteHello*)msg;
+    if (h->magic != REMOTE_MAGIC || h->version != REMOTE_VERSION || h->type != REMOTE_MSG_HELLO)
+        return FALSE;
+
+    // Four length prefixes per sensor at least
+    p = msg + sizeof(RemoteHello);
+    end = msg + len;
+    if ((gsize)(end - p) / 8 < h->sensor_count)
+        return FALSE;
+
+    sensor_count = h->sensor_count;
+    remote_sensors = g_new0(RemoteSensor, sensor_count);
+
+    for (i = 0; i < sensor_count; i++) {
+        source = get_str(&p, end);
+        remote_sensors[i].label = get_str(&p, end);
+        hint = get_str(&p, end);
+        remote_sensors[i].printf_format = get_str(&p, end);
+        if (!source || !remote_sensors[i].label || !hint || !remote_sensors[i].printf_format ||
+            end - p < sizeof(RemoteTopology)) {
+            g_free(source);
+            g_free(hint);
+            free_remote_sensors();
+            return FALSE;
+        }
+
+        // Formats end up in printf
+        if (!sensor_format_is_safe(remote_sensors[i].printf_format)) {
+            g_free(remote_sensors[i].printf_format);
+            remote_sensors[i].printf_format = g_strdup(" %8.3f");
+        }
+        memcpy(&remote_sensors[i].topology, p, sizeof(RemoteTopology));
+        p += sizeof(RemoteTopology);
+
+        // Mention the server in the tooltip
+        remote_sensors[i].hint = g_strdup_printf("%s\nVia: zenmonitor server (%s) at %s",
+                                                 hint, source, socket_path);
+        g_free(source);
+        g_free(hint);
+    }
+
+    return TRUE;
+}
+
+void remote_set_socket(const gchar *path) {
+    g_free(socket_path);
+    socket_path = g_strdup(path);
+}
+
+gboolean remote_init() {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    guint i;
+
+    if (!socket_path)
+        socket_path = g_strdup(REMOTE_DEFAULT_SOCKET);
+    if (strlen(socket_path) >= sizeof addr.sun_path)
+        return FALSE;
+    strcpy(addr.sun_path, socket_path);
+
+    sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (sock < 0)
+        return FALSE;
+
+    if (connect(sock, (struct sockaddr*)&addr, sizeof addr) < 0 || !server_trusted() || !read_hello()) {
+        g_printerr("Unable to connect to zenmonitor server at %s\n", socket_path);
+        close(sock);
+        sock = -1;
+        return FALSE;
+    }
+
+    remote_value = g_new(gfloat, sensor_count);
+    remote_min = g_new(gfloat, sensor_count);
+    remote_max = g_new(gfloat, sensor_count);
+    for (i = 0; i < sensor_count; i++)
+        remote_value[i] = remote_min[i] = remote_max[i] = ERROR_VALUE;
+
+    return TRUE;
+}
+
+void remote_update() {
+    const RemoteFrame *f;
+    const RemoteValue *v;
+    gssize len;
+    guint i;
+
+    if (sock < 0)
+        return;
+
+    // Drain everything queued and keep only the newest frame
+    while ((len = recv_msg(MSG_DONTWAIT)) > 0) {
+        f = (const RemoteFrame*)msg;
+        if (len >= (gssize)(sizeof(RemoteFrame) + sensor_count * sizeof(RemoteValue)) &&
+            f->magic == REMOTE_MAGIC && f->type == REMOTE_MSG_FRAME && f->sensor_count == sensor_count) {
+
+            v = (const RemoteValue*)(msg + sizeof(RemoteFrame));
+            for (i = 0; i < sensor_count; i++) {
+                remote_value[i] = v[i].value;
+                if (!local_minmax) {
+                    remote_min[i] = v[i].min;
+                    remote_max[i] = v[i].max;
+                    if (remote_inits && remote_inits[i])
+                        remote_inits[i]->stale = v[i].stale;
+                }
+                else if (v[i].value != ERROR_VALUE) {
+                    if (remote_min[i] == ERROR_VALUE || v[i].value < remote_min[i])
+                        remote_min[i] = v[i].value;
+                    if (remote_max[i] == ERROR_VALUE || v[i].value > remote_max[i])
+                        remote_max[i] = v[i].value;
+                }
+            }
+        }
+    }
+
+    if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        // Server went away
+        close(sock);
+        sock = -1;
+        for (i = 0; i < sensor_count; i++)
+            remote_value[i] = ERROR_VALUE;
+    }
+}
+
+void remote_clear_minmax() {
+    guint i;
+
+    local_minmax = TRUE;
+    for (i = 0; i < sensor_count; i++)
+        remote_min[i] = remote_max[i] = remote_value[i];
+}
+
+GSList* remote_get_sensors() {
+    GSList *list = NULL;
+    SensorInit *data;
+    guint i;
+
+    remote_inits = g_new0(SensorInit*, sensor_count);
+    for (i = 0; i < sensor_count; i++) {
+        data = sensor_init_new();
+        remote_inits[i] = data;
+        data->label = g_strdup(remote_sensors[i].label);
+        data->hint = g_strdup(remote_sensors[i].hint);
+        data->value = &remote_value[i];
+        data->min = &remote_min[i];
+        data->max = &remote_max[i];
+        data->printf_format = remote_sensors[i].printf_format;
+        data->node = remote_sensors[i].topology.node;
+        data->ccx = remote_sensors[i].topology.ccx;
+        data->core = remote_sensors[i].topology.core;
+        data->aggregate = remote_sensors[i].topology.aggregate;
+        list = g_slist_append(list, data);
+    }
+
+    return list;
+}
@@ -0,0 +1,335 @@
+#include <glib.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "zenmonitor.h"
+#include "msr.h"
+#include "thermal.h"
+
+#define THERMAL_TIME_PRINTF_FORMAT " %8.1f s"
+#define THERMAL_PWR_PRINTF_FORMAT " %8.3f W"
+#define THERMAL_MAX_SECONDS 3600.0
+#define THERMAL_WARMUP 30           // samples before the fit is trusted
+#define RLS_FORGET 0.998            // about the last 500 samples count
+#define RLS_MAX_TRACE 1e6           // stop forgetting while the input does not move
+
+// One first order RC model per CCD (or per package without CCD sensors),
+// fitted online as dT/dt = a*T + b*P + c with recursive least squares.
+// a < 0 is the cooling rate, b > 0 the heating per watt. Cost per tick is
+// constant, a 3x3 covariance update.
+typedef struct {
+    gint node;
+    gchar *name;
+    SensorInit *temp;
+    GPtrArray *power;           // SensorInit, summed
+
+    gdouble theta[3];
+    gdouble cov[3][3];
+    guint samples;
+
+    gboolean have_last;
+    gdouble last_temp;
+    gdouble last_power;
+    gint64 last_time;
+
+    SensorInit *time_sensor;
+    gfloat time_left;
+    gfloat time_min;
+    gfloat time_max;
+
+    SensorInit *power_sensor;
+    gfloat sustainable;
+    gfloat sustainable_min;
+    gfloat sustainable_max;
+} ThermalModel;
+
+static GPtrArray *models = NULL;
+
+static void rls_update(ThermalModel *m, const gdouble x[3], gdouble y) {
+    gdouble px[3], k[3], denom, err, lambda;
+    guint i, j;
+
+    lambda = m->cov[0][0] + m->cov[1][1] + m->cov[2][2] > RLS_MAX_TRACE ? 1.0 : RLS_FORGET;
+
+    for (i = 0; i < 3; i++)
+        px[i] = m->cov[i][0] * x[0] + m->cov[i][1] * x[1] + m->cov[i][2] * x[2];
+
+    denom = lambda + x[0] * px[0] + x[1] * px[1] + x[2] * px[2];
+    err = y - (m->theta[0] * x[0] + m->theta[1] * x[1] + m->theta[2] * x[2]);
+
+    for (i = 0; i < 3; i++) {
+        k[i] = px[i] / denom;
+        m->theta[i] += k[i] * err;
+    }
+
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < 3; j++)
+            m->cov[i][j] = (m->cov[i][j] - k[i] * px[j]) / lambda;
+    }
+
+    m->samples++;
+}
+
+static void model_reset(ThermalModel *m) {
+    memset(m->theta, 0, sizeof m->theta);
+    memset(m->cov, 0, sizeof m->cov);
+    m->cov[0][0] = m->cov[1][1] = m->cov[2][2] = 1000.0;
+    m->samples = 0;
+    m->have_last = FALSE;
+}
+
+static void predict(ThermalModel *m, gdouble temp, gdouble power) {
+    gdouble a = m->theta[0], b = m->theta[1], c = m->theta[2];
+    gdouble limit = thermal_limit, steady, seconds;
+
+    if (m->samples < THERMAL_WARMUP || a >= 0 || b <= 0) {
+        m->time_left = m->sustainable = ERROR_VALUE;
+        return;
+    }
+
+    // Power at which the steady state temperature is the limit
+    sensor_track(MAX(-(a * limit + c) / b, 0), &m->sustainable, &m->sustainable_min, &m->sustainable_max);
+
+    // T(t) = steady + (temp - steady) * e^(a*t)
+    steady = -(b * power + c) / a;
+    if (temp >= limit)
+        seconds = 0;
+    else if (steady <= limit)
+        seconds = THERMAL_MAX_SECONDS;
+    else
+        seconds = MIN(log((limit - steady) / (temp - steady)) / a, THERMAL_MAX_SECONDS);
+
+    sensor_track(seconds, &m->time_left, &m->time_min, &m->time_max);
+}
+
+void thermal_update() {
+    ThermalModel *m;
+    gdouble temp, power, dt, x[3];
+    gboolean time_needed, power_needed;
+    gint64 now;
+    guint i;
+
+    now = g_get_monotonic_time();
+
+    for (i = 0; i < models->len; i++) {
+        m = g_ptr_array_index(models, i);
+
+        // A fit with gaps is still valid, the next sample just starts fresh
+        time_needed = sensor_needed(m->time_sensor);
+        power_needed = sensor_needed(m->power_sensor);
+        if (!time_needed && !power_needed) {
+            m->have_last = FALSE;
+            continue;
+        }
+
+        temp = *m->temp->value;
+        power = sensors_sum(m->power);
+        if (temp == ERROR_VALUE || power == ERROR_VALUE) {
+            m->have_last = FALSE;
+            m->time_left = m->sustainable = ERROR_VALUE;
+            continue;
+        }
+
+        if (m->have_last) {
+            dt = (now - m->last_time) / 1e6;
+            if (dt > 0.01 && dt < 10.0) {
+                x[0] = m->last_temp;
+                x[1] = m->last_power;
+                x[2] = 1.0;
+                rls_update(m, x, (temp - m->last_temp) / dt);
+            }
+        }
+
+        m->have_last = TRUE;
+        m->last_temp = temp;
+        m->last_power = power;
+        m->last_time = now;
+
+        predict(m, temp, power);
+    }
+}
+
+static ThermalModel* model_new(gint node, gchar *name, SensorInit *temp) {
+    ThermalModel *m = g_new0(ThermalModel, 1);
+
+    m->node = node;
+    m->name = name;
+    m->temp = temp;
+    m->power = g_ptr_array_new();
+    m->time_left = m->time_min = m->time_max = ERROR_VALUE;
+    m->sustainable = m->sustainable_min = m->sustainable_max = ERROR_VALUE;
+    model_reset(m);
+    return m;
+}
+
+static gint compare_ints(gconstpointer a, gconstpointer b) {
+    return *(const gint*)a - *(const gint*)b;
+}
+
+static guint ccx_index(GArray *ccx_ids, gint ccx) {
+    guint i;
+
+    for (i = 0; i < ccx_ids->len; i++) {
+        if (g_array_index(ccx_ids, gint, i) == ccx)
+            break;
+    }
+    return i;
+}
+
+// CCDs in label order get consecutive CCX of the node, ccx/2 on Zen 2 and
+// ccx on Zen 3 where a CCD has a single CCX
+static void init_node(gint node) {
+    SensorInit *data, *die = NULL, *package = NULL, *ccd[16] = { NULL };
+    GArray *ccx_ids;
+    GPtrArray *cores;
+    ThermalModel *m;
+    const gchar *p;
+    gint ids[16], n, ccds = 0, per, index;
+    GSList *l;
+    guint i;
+
+    for (l = sensor_source_sensors("hwmon"); l; l = l->next) {
+        data = l->data;
+        if (MAX(data->node, 0) != node)
+            continue;
+
+        p = strstr(data->label, "CCD");
+        if (p && sscanf(p, "CCD%d Temperature", &n) == 1 && ccds < 16) {
+            // Insertion keeps the CCDs sorted by number
+            for (index = ccds; index > 0 && ids[index - 1] > n; index--) {
+                ids[index] = ids[index - 1];
+                ccd[index] = ccd[index - 1];
+            }
+            ids[index] = n;
+            ccd[index] = data;
+            ccds++;
+        }
+        else if (g_str_has_suffix(data->label, "CPU Temperature (tDie)") ||
+                 (!die && g_str_has_suffix(data->label, "CPU Temperature (tCtl)"))) {
+            die = data;
+        }
+    }
+
+    // Called only while the msr source is enabled
+    package = msr_package_sensor(node);
+    cores = msr_core_power_sensors(node);
+    ccx_ids = g_array_new(FALSE, FALSE, sizeof(gint));
+    for (i = 0; i < cores->len; i++) {
+        data = g_ptr_array_index(cores, i);
+        if (ccx_index(ccx_ids, data->ccx) == ccx_ids->len)
+            g_array_append_val(ccx_ids, data->ccx);
+    }
+    g_array_sort(ccx_ids, compare_ints);
+
+    // CCXs that do not split evenly over the CCDs cannot be assigned by
+    // position, the whole package is modeled on the die temperature instead
+    if (ccds > 0 && cores->len > 0 && ccx_ids->len >= (guint)ccds && ccx_ids->len % ccds == 0) {
+        per = ccx_ids->len / ccds;
+        for (index = 0; index < ccds; index++) {
+            m = model_new(node, g_strdup_printf("CCD%d", ids[index]), ccd[index]);
+            for (i = 0; i < cores->len; i++) {
+                data = g_ptr_array_index(cores, i);
+                if ((gint)ccx_index(ccx_ids, data->ccx) / per == index)
+                    g_ptr_array_add(m->power, data);
+            }
+
+            if (m->power->len > 0)
+                g_ptr_array_add(models, m);
+        }
+    }
+    else if (die && (package || cores->len > 0)) {
+        m = model_new(node, g_strdup("CPU"), die);
+        if (package) {
+            g_ptr_array_add(m->power, package);
+        }
+        else {
+            for (i = 0; i < cores->len; i++)
+                g_ptr_array_add(m->power, g_ptr_array_index(cores, i));
+        }
+        g_ptr_array_add(models, m);
+    }
+
+    g_array_free(ccx_ids, TRUE);
+    g_ptr_array_free(cores, TRUE);
+}
+
+gboolean thermal_init() {
+    guint node;
+
+    if (models)
+        return models->len > 0;
+    models = g_ptr_array_new();
+
+    if (!sensor_source_sensors("msr"))
+        return FALSE;
+
+    for (node = 0; node < msr_node_count(); node++)
+        init_node(node);
+
+    return models->len > 0;
+}
+
+void thermal_clear_minmax() {
+    ThermalModel *m;
+    guint i;
+
+    for (i = 0; i < models->len; i++) {
+        m = g_ptr_array_index(models, i);
+        m->time_min = m->time_max = m->time_left;
+        m->sustainable_min = m->sustainable_max = m->sustainable;
+    }
+}
+
+static SensorInit* new_sensor(ThermalModel *m, gboolean multi_node, const gchar *what, gchar *hint,
+                              const gchar *printf_format, gfloat *value, gfloat *min, gfloat *max) {
+    SensorInit *data;
+    guint i;
+
+    data = sensor_init_new();
+    if (multi_node)
+        data->label = g_strdup_printf("Node %d - %s %s", m->node, m->name, what);
+    else
+        data->label = g_strdup_printf("%s %s", m->name, what);
+    data->hint = hint;
+    data->value = value;
+    data->min = min;
+    data->max = max;
+    data->printf_format = printf_format;
+    data->node = m->node;
+
+    data->deps = g_slist_prepend(data->deps, m->temp);
+    for (i = 0; i < m->power->len; i++)
+        data->deps = g_slist_prepend(data->deps, g_ptr_array_index(m->power, i));
+    return data;
+}
+
+GSList* thermal_get_sensors() {
+    GSList *list = NULL;
+    ThermalModel *m;
+    gboolean multi_node = FALSE;
+    guint i;
+
+    for (i = 0; i < models->len; i++)
+        multi_node |= ((ThermalModel*)g_ptr_array_index(models, i))->node > 0;
+
+    for (i = 0; i < models->len; i++) {
+        m = g_ptr_array_index(models, i);
+
+        m->time_sensor = new_sensor(m, multi_node, "Time to Thermal Limit",
+            g_strdup_printf("Seconds until %s reaches %d°C at the current power\n"
+                            "Predicted by a thermal model fitted to %s and power history\n"
+                            "%.0f means not within that time", m->name, thermal_limit,
+                            m->temp->label, THERMAL_MAX_SECONDS),
+            THERMAL_TIME_PRINTF_FORMAT, &m->time_left, &m->time_min, &m->time_max);
+        list = g_slist_append(list, m->time_sensor);
+
+        m->power_sensor = new_sensor(m, multi_node, "Sustainable Power",
+            g_strdup_printf("Power %s can draw indefinitely without exceeding %d°C\n"
+                            "Predicted by a thermal model fitted to %s and power history",
+                            m->name, thermal_limit, m->temp->label),
+            THERMAL_PWR_PRINTF_FORMAT, &m->sustainable, &m->sustainable_min, &m->sustainable_max);
+        list = g_slist_append(list, m->power_sensor);
+    }
+
+    return list;
+}
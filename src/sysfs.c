@@ -4,6 +4,7 @@
 #include <string.h>
 #include "sysfs.h"
 #include "zenmonitor.h"
+#include "manifest.h"
 
 #define CPUD_MAX 512
 struct bitset {
@@ -24,7 +25,46 @@ static int cmp_cpudev(const void *ap, const void *bp) {
     return ((struct cpudev *)ap)->cpuid - ((struct cpudev *)bp)->cpuid;
 }
 
-struct cpudev* get_cpu_dev_ids(void) {
+static gshort read_cpu_attr(gshort cpuid, const gchar *attr) {
+    gchar *filename, *buffer;
+    gshort value = -1;
+
+    filename = g_strdup_printf(SYSFS_DIR_CPUS "/cpu%d/%s", cpuid, attr);
+    if (g_file_get_contents(filename, &buffer, NULL, NULL)) {
+        value = (gshort) atoi(buffer);
+        g_free(buffer);
+    }
+    g_free(filename);
+
+    return value;
+}
+
+// L3 ids are not guaranteed to be dense, renumber them in cpu order
+static void number_ccx(struct cpudev *cpu_dev_ids, guint cores) {
+    GHashTable *l3_ids;
+    gpointer index;
+    gshort l3;
+    guint i;
+
+    l3_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (i = 0; i < cores; i++) {
+        if (cpu_dev_ids[i].cpuid < 0)
+            continue;
+
+        l3 = read_cpu_attr(cpu_dev_ids[i].cpuid, "cache/index3/id");
+        if (l3 < 0)
+            continue;
+
+        if (!g_hash_table_lookup_extended(l3_ids, GINT_TO_POINTER(l3), NULL, &index)) {
+            index = GINT_TO_POINTER(g_hash_table_size(l3_ids));
+            g_hash_table_insert(l3_ids, GINT_TO_POINTER(l3), index);
+        }
+        cpu_dev_ids[i].ccx = GPOINTER_TO_INT(index);
+    }
+    g_hash_table_destroy(l3_ids);
+}
+
+static struct cpudev* scan_cpu_dev_ids(guint cores) {
     struct cpudev *cpu_dev_ids;
     gshort coreid, cpuid, siblingid;
     GDir *dir;
@@ -32,15 +72,13 @@ struct cpudev* get_cpu_dev_ids(void) {
     gchar *filename, *buffer;
     gchar **cpusiblings;
     gchar **ptr;
-    guint cores;
     gboolean found;
     struct bitset seen = { 0 };
     int i;
 
-    cores = get_core_count();
     cpu_dev_ids = malloc(cores * sizeof (*cpu_dev_ids));
     for (i=0;i<cores;i++)
-        cpu_dev_ids[i] = (struct cpudev) { -1, -1 };
+        cpu_dev_ids[i] = (struct cpudev) { -1, -1, -1, -1 };
 
     dir = g_dir_open(SYSFS_DIR_CPUS, 0, NULL);
     if (dir) {
@@ -82,7 +120,7 @@ struct cpudev* get_cpu_dev_ids(void) {
             }
 
             if (found && i < cores) {
-                cpu_dev_ids[i++] = (struct cpudev) { coreid, cpuid };
+                cpu_dev_ids[i++] = (struct cpudev) { coreid, cpuid, read_cpu_attr(cpuid, "topology/physical_package_id"), -1 };
             }
 
             g_free(filename);
@@ -91,6 +129,143 @@ struct cpudev* get_cpu_dev_ids(void) {
     }
 
     qsort(cpu_dev_ids, cores, sizeof(*cpu_dev_ids), cmp_cpudev);
+    number_ccx(cpu_dev_ids, cores);
 
     return cpu_dev_ids;
 }
+
+// Manifest entries are "coreid:cpuid:node:ccx", one per core
+static struct cpudev* load_cpu_dev_ids(guint cores) {
+    struct cpudev *cpu_dev_ids;
+    gchar **list;
+    gsize n;
+    guint i;
+
+    list = manifest_get_list("topology", "cores", &n);
+    if (!list || n != cores) {
+        g_strfreev(list);
+        return NULL;
+    }
+
+    cpu_dev_ids = malloc(cores * sizeof (*cpu_dev_ids));
+    for (i = 0; i < cores; i++) {
+        if (sscanf(list[i], "%hd:%hd:%hd:%hd", &cpu_dev_ids[i].coreid, &cpu_dev_ids[i].cpuid,
+                   &cpu_dev_ids[i].node, &cpu_dev_ids[i].ccx) != 4) {
+            free(cpu_dev_ids);
+            cpu_dev_ids = NULL;
+            break;
+        }
+    }
+
+    g_strfreev(list);
+    return cpu_dev_ids;
+}
+
+static void store_cpu_dev_ids(const struct cpudev *cpu_dev_ids, guint cores) {
+    gchar **list;
+    guint i;
+
+    list = g_new0(gchar*, cores + 1);
+    for (i = 0; i < cores; i++)
+        list[i] = g_strdup_printf("%d:%d:%d:%d", cpu_dev_ids[i].coreid, cpu_dev_ids[i].cpuid,
+                                  cpu_dev_ids[i].node, cpu_dev_ids[i].ccx);
+
+    manifest_set_list("topology", "cores", (const gchar * const *)list, cores);
+    g_strfreev(list);
+}
+
+// Topology does not change while running, all callers share one copy
+struct cpudev* get_cpu_dev_ids(void) {
+    static gsize cached = 0;
+    struct cpudev *cpu_dev_ids;
+    guint cores;
+
+    if (g_once_init_enter(&cached)) {
+        cores = get_core_count();
+        cpu_dev_ids = load_cpu_dev_ids(cores);
+        if (!cpu_dev_ids) {
+            cpu_dev_ids = scan_cpu_dev_ids(cores);
+            store_cpu_dev_ids(cpu_dev_ids, cores);
+        }
+        g_once_init_leave(&cached, (gsize)cpu_dev_ids);
+    }
+
+    return (struct cpudev*)cached;
+}
+
+gint *get_cpu_core_map(guint *ncpus) {
+    struct cpudev *cpu_dev_ids;
+    GDir *dir;
+    const gchar *entry;
+    gchar *filename, *buffer;
+    gchar **cpusiblings;
+    gshort cpuid, first;
+    guint cores, max_cpu = 0;
+    gint *map;
+    GSList *cpus = NULL, *node;
+    gint i;
+
+    dir = g_dir_open(SYSFS_DIR_CPUS, 0, NULL);
+    if (!dir) {
+        *ncpus = 0;
+        return NULL;
+    }
+
+    while ((entry = g_dir_read_name(dir))) {
+        if (sscanf(entry, "cpu%hd", &cpuid) != 1)
+            continue;
+
+        cpus = g_slist_prepend(cpus, GINT_TO_POINTER(cpuid));
+        max_cpu = MAX(max_cpu, cpuid + 1);
+    }
+    g_dir_close(dir);
+
+    cores = get_core_count();
+    cpu_dev_ids = get_cpu_dev_ids();
+    map = g_new(gint, max_cpu);
+    for (i = 0; i < max_cpu; i++)
+        map[i] = -1;
+
+    // Every logical CPU maps to the core whose lowest thread sibling it shares
+    for (node = cpus; node; node = node->next) {
+        cpuid = GPOINTER_TO_INT(node->data);
+        filename = g_strdup_printf(SYSFS_DIR_CPUS "/cpu%d/topology/thread_siblings_list", cpuid);
+        if (g_file_get_contents(filename, &buffer, NULL, NULL)) {
+            cpusiblings = g_strsplit_set(buffer, ",-", -1);
+            first = (gshort) atoi(cpusiblings[0]);
+            for (i = 0; i < cores; i++) {
+                if (cpu_dev_ids[i].cpuid == first) {
+                    map[cpuid] = i;
+                    break;
+                }
+            }
+            g_strfreev(cpusiblings);
+            g_free(buffer);
+        }
+        g_free(filename);
+    }
+
+    g_slist_free(cpus);
+
+    *ncpus = max_cpu;
+    return map;
+}
+
+// Physical package of the first CPU of a NUMA node, -1 if unknown
+gshort get_numa_node_package(gint numa) {
+    gchar *filename, *buffer;
+    gshort package = -1;
+
+    if (numa < 0)
+        return -1;
+
+    filename = g_strdup_printf("/sys/devices/system/node/node%d/cpulist", numa);
+    if (g_file_get_contents(filename, &buffer, NULL, NULL)) {
+        if (g_ascii_isdigit(buffer[0]))
+            package = read_cpu_attr((gshort) atoi(buffer), "topology/physical_package_id");
+        g_free(buffer);
+    }
+    g_free(filename);
+
+    return package;
+}
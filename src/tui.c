@@ -0,0 +1,321 @@
+#include <glib.h>
+#include <curses.h>
+#include <locale.h>
+#include <string.h>
+#include "zenmonitor.h"
+#include "tui.h"
+#include "alerts.h"
+
+#define TUI_REFRESH_MS 300
+#define TUI_VALUE_WIDTH 14
+#define TUI_LABEL_MAX 48
+#define TUI_FILTER_MAX 64
+
+typedef struct {
+    SensorInit *sensor;
+    SensorSource *source;
+} TuiRow;
+
+// What is currently on screen for one list line. Cells are only formatted
+// and redrawn when the value behind them changed.
+typedef struct {
+    gint row;
+    gfloat value;
+    gfloat min;
+    gfloat max;
+    gboolean stale;
+} TuiLine;
+
+static SensorSource *sensor_sources;
+static GArray *rows;            // TuiRow, all sensors
+static GArray *visible;         // guint, indices into rows that match the filter
+static TuiLine *lines = NULL;
+static gint nlines = 0;
+static gint scroll_top = 0;
+static gint label_width = 0;
+static gchar filter_text[TUI_FILTER_MAX + 1] = "";
+static gboolean editing_filter = FALSE;
+static gchar *model_name;
+
+static void apply_filter() {
+    TuiRow *row;
+    guint i;
+
+    g_array_set_size(visible, 0);
+    for (i = 0; i < rows->len; i++) {
+        row = &g_array_index(rows, TuiRow, i);
+        if (!filter_text[0] || sensor_label_matches(row->sensor->label, filter_text))
+            g_array_append_val(visible, i);
+    }
+    scroll_top = 0;
+}
+
+static void draw_cell(gint y, gint col, gfloat num, const gchar *printf_format, gboolean stale) {
+    gchar buf[64];
+
+    if (num != ERROR_VALUE)
+        g_snprintf(buf, sizeof buf, printf_format, num);
+    else
+        g_strlcpy(buf, "    ? ? ?", sizeof buf);
+
+    // Min/max that missed samples while the sensor was off screen are dimmed,
+    // the cell has no room to spare for a mark
+    if (stale)
+        attron(A_DIM);
+    mvprintw(y, label_width + 1 + col * TUI_VALUE_WIDTH, "%-*s", TUI_VALUE_WIDTH, buf);
+    if (stale)
+        attroff(A_DIM);
+}
+
+static void draw_frame() {
+    gint i;
+
+    erase();
+
+    attron(A_REVERSE);
+    mvprintw(0, 0, "%-*s", COLS, " Zen monitor");
+    mvprintw(0, 14, "%s", model_name);
+    attroff(A_REVERSE);
+
+    attron(A_BOLD);
+    mvprintw(1, 0, "%-*s", label_width, "Sensor");
+    mvprintw(1, label_width + 1, "%-*s%-*s%-*s",
+             TUI_VALUE_WIDTH, "Value", TUI_VALUE_WIDTH, "Min", TUI_VALUE_WIDTH, "Max");
+    attroff(A_BOLD);
+
+    attron(A_REVERSE);
+    if (editing_filter || filter_text[0])
+        mvprintw(LINES - 1, 0, "%-*s", COLS, "");
+    if (editing_filter)
+        mvprintw(LINES - 1, 0, " Filter: %s_", filter_text);
+    else if (filter_text[0])
+        mvprintw(LINES - 1, 0, " Filter: %s   (/ edit, Esc clear)  q quit  c clear min/max", filter_text);
+    else
+        mvprintw(LINES - 1, 0, "%-*s", COLS, " q quit  c clear min/max  / filter  arrows/PgUp/PgDn scroll");
+    attroff(A_REVERSE);
+
+    // Force every list line to be drawn again
+    for (i = 0; i < nlines; i++) {
+        if (lines[i].row >= 0)
+            sensor_unobserve(g_array_index(rows, TuiRow, lines[i].row).sensor);
+    }
+    g_free(lines);
+    nlines = MAX(LINES - 3, 0);
+    lines = g_new(TuiLine, MAX(nlines, 1));
+    for (i = 0; i < nlines; i++)
+        lines[i].row = -1;
+}
+
+static void draw_rows() {
+    TuiLine *line;
+    TuiRow *row;
+    SensorInit *s;
+    gint i, index;
+
+    for (i = 0; i < nlines; i++) {
+        line = &lines[i];
+        index = scroll_top + i < visible->len ? (gint)g_array_index(visible, guint, scroll_top + i) : -1;
+
+        if (index != line->row) {
+            move(i + 2, 0);
+            clrtoeol();
+            // Only sensors on screen are read from the hardware
+            if (line->row >= 0)
+                sensor_unobserve(g_array_index(rows, TuiRow, line->row).sensor);
+            if (index >= 0)
+                sensor_observe(g_array_index(rows, TuiRow, index).sensor);
+            line->row = index;
+            if (index < 0)
+                continue;
+
+            s = g_array_index(rows, TuiRow, index).sensor;
+            mvprintw(i + 2, 0, "%-.*s", label_width, s->label);
+            line->value = line->min = line->max = G_MAXFLOAT;
+            line->stale = FALSE;
+        }
+        if (index < 0)
+            continue;
+
+        row = &g_array_index(rows, TuiRow, index);
+        if (!row->source->enabled)
+            continue;
+
+        s = row->sensor;
+        if (*s->value != line->value) {
+            line->value = *s->value;
+            draw_cell(i + 2, 0, line->value, s->printf_format, FALSE);
+        }
+        if (*s->min != line->min || s->stale != line->stale) {
+            line->min = *s->min;
+            draw_cell(i + 2, 1, line->min, s->printf_format, s->stale);
+        }
+        if (*s->max != line->max || s->stale != line->stale) {
+            line->max = *s->max;
+            draw_cell(i + 2, 2, line->max, s->printf_format, s->stale);
+        }
+        line->stale = s->stale;
+    }
+}
+
+static void update_sources() {
+    SensorSource *source;
+
+    for (source = sensor_sources; source->drv; source++) {
+        if (source->enabled)
+            source->func_update();
+    }
+    alerts_evaluate();
+}
+
+static void clear_minmax() {
+    SensorSource *source;
+
+    for (source = sensor_sources; source->drv; source++) {
+        if (source->enabled)
+            sensor_source_clear_minmax(source);
+    }
+}
+
+// Returns FALSE when the user asked to quit
+static gboolean handle_key(gint ch, gboolean *frame_dirty) {
+    gsize len = strlen(filter_text);
+    gint page = MAX(nlines - 1, 1);
+    gint max_scroll = MAX((gint)visible->len - nlines, 0);
+
+    if (editing_filter) {
+        if (ch == '\n' || ch == KEY_ENTER) {
+            editing_filter = FALSE;
+        }
+        else if (ch == 27) {
+            editing_filter = FALSE;
+            filter_text[0] = 0;
+            apply_filter();
+        }
+        else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
+            if (len > 0)
+                filter_text[len - 1] = 0;
+            apply_filter();
+        }
+        else if (ch >= 32 && ch < 256 && len < TUI_FILTER_MAX) {
+            filter_text[len] = ch;
+            filter_text[len + 1] = 0;
+            apply_filter();
+        }
+        *frame_dirty = TRUE;
+        return TRUE;
+    }
+
+    switch (ch) {
+        case 'q':
+        case 'Q':
+            return FALSE;
+        case 'c':
+        case 'C':
+            clear_minmax();
+            break;
+        case '/':
+            editing_filter = TRUE;
+            *frame_dirty = TRUE;
+            break;
+        case 27:
+            filter_text[0] = 0;
+            apply_filter();
+            *frame_dirty = TRUE;
+            break;
+        case KEY_UP:
+            scroll_top = MAX(scroll_top - 1, 0);
+            break;
+        case KEY_DOWN:
+            scroll_top = MIN(scroll_top + 1, max_scroll);
+            break;
+        case KEY_PPAGE:
+            scroll_top = MAX(scroll_top - page, 0);
+            break;
+        case KEY_NPAGE:
+            scroll_top = MIN(scroll_top + page, max_scroll);
+            break;
+        case KEY_HOME:
+            scroll_top = 0;
+            break;
+        case KEY_END:
+            scroll_top = max_scroll;
+            break;
+        case KEY_RESIZE:
+            *frame_dirty = TRUE;
+            break;
+    }
+    return TRUE;
+}
+
+int start_tui(SensorSource *ss) {
+    SensorSource *source;
+    GSList *node;
+    TuiRow row;
+    gint64 next, now;
+    gboolean running = TRUE, frame_dirty = TRUE;
+    gint ch;
+
+    sensor_sources = ss;
+    rows = g_array_new(FALSE, FALSE, sizeof(TuiRow));
+    visible = g_array_new(FALSE, FALSE, sizeof(guint));
+
+    sensor_sources_init(sensor_sources);
+    for (source = sensor_sources; source->drv; source++) {
+        if (!source->enabled)
+            continue;
+
+        for (node = source->sensors; node; node = node->next) {
+            row.sensor = node->data;
+            row.source = source;
+            g_array_append_val(rows, row);
+            label_width = MAX(label_width, (gint)g_utf8_strlen(row.sensor->label, -1));
+        }
+    }
+    label_width = MIN(label_width + 2, TUI_LABEL_MAX);
+    alerts_bind(sensor_sources);
+    apply_filter();
+
+    if (rows->len == 0) {
+        g_printerr("No sensors available\n");
+        return 1;
+    }
+
+    model_name = cpu_model();
+
+    setlocale(LC_ALL, "");
+    initscr();
+    cbreak();
+    noecho();
+    curs_set(0);
+    keypad(stdscr, TRUE);
+    set_escdelay(25);
+
+    next = g_get_monotonic_time();
+    while (running) {
+        if (frame_dirty) {
+            draw_frame();
+            frame_dirty = FALSE;
+        }
+
+        // Lines pick their sensors first, so the tick reads what is on screen
+        draw_rows();
+
+        now = g_get_monotonic_time();
+        if (now >= next) {
+            update_sources();
+            next = now + TUI_REFRESH_MS * 1000;
+            draw_rows();
+        }
+        refresh();
+
+        // Wait for a key until the next tick is due
+        now = g_get_monotonic_time();
+        timeout(next > now ? (gint)((next - now) / 1000) : 0);
+        ch = getch();
+        if (ch != ERR)
+            running = handle_key(ch, &frame_dirty);
+    }
+
+    endwin();
+    return 0;
+}
@@ -0,0 +1,491 @@
+#include <gtk/gtk.h>
+#include <math.h>
+#include <string.h>
+#include "zenmonitor.h"
+#include "zmlog.h"
+#include "viewer.h"
+
+// Min/max/mean pyramid of one sensor. Level 0 holds the raw samples, every
+// following level halves the number of buckets. Unreadable samples are NAN.
+// count holds the readable samples behind each bucket, for weighted means.
+typedef struct {
+    guint levels;
+    guint64 *len;
+    gfloat **min;
+    gfloat **max;
+    gfloat **mean;
+    guint64 **count;            // count[0] is implied by the raw samples
+} Pyramid;
+
+static GtkWidget *window;
+static GtkWidget *plot;
+static GtkWidget *stats_label;
+static ZmLogReader *zlog;
+static Pyramid **pyramids;
+static gint selected = -1;
+
+static gdouble view_start = 0;
+static gdouble view_rows = 0;
+static gdouble drag_x = -1;
+
+enum {
+    COLUMN_NAME,
+    COLUMN_HINT,
+    COLUMN_INDEX,
+    NUM_COLUMNS
+};
+
+static gfloat nan_min(gfloat a, gfloat b) {
+    return isnan(a) ? b : (isnan(b) ? a : MIN(a, b));
+}
+
+static gfloat nan_max(gfloat a, gfloat b) {
+    return isnan(a) ? b : (isnan(b) ? a : MAX(a, b));
+}
+
+static guint64 bucket_count(Pyramid *p, guint l, guint64 i) {
+    return l ? p->count[l][i] : !isnan(p->mean[0][i]);
+}
+
+static Pyramid *pyramid_build(guint sensor) {
+    Pyramid *p;
+    ZmLogChunk *chunk;
+    gfloat *raw;
+    guint64 i, n, ca, cb;
+    guint c, l;
+
+    if (zlog->rows == 0)
+        return NULL;
+
+    raw = g_new(gfloat, zlog->rows);
+    for (c = 0; c < zlog->chunks->len; c++) {
+        chunk = &g_array_index(zlog->chunks, ZmLogChunk, c);
+        if (!zmlog_reader_column(zlog, c, sensor, &raw[chunk->first_row])) {
+            for (i = 0; i < chunk->rows; i++)
+                raw[chunk->first_row + i] = NAN;
+        }
+    }
+    for (i = 0; i < zlog->rows; i++) {
+        if (raw[i] == ERROR_VALUE)
+            raw[i] = NAN;
+    }
+
+    p = g_new0(Pyramid, 1);
+    for (n = zlog->rows; n > 1; n = (n + 1) / 2)
+        p->levels++;
+    p->levels++;
+
+    p->len = g_new(guint64, p->levels);
+    p->min = g_new(gfloat*, p->levels);
+    p->max = g_new(gfloat*, p->levels);
+    p->mean = g_new(gfloat*, p->levels);
+    p->count = g_new(guint64*, p->levels);
+
+    p->len[0] = zlog->rows;
+    p->min[0] = p->max[0] = p->mean[0] = raw;
+    p->count[0] = NULL;
+
+    for (l = 1; l < p->levels; l++) {
+        n = p->len[l] = (p->len[l - 1] + 1) / 2;
+        p->min[l] = g_new(gfloat, n);
+        p->max[l] = g_new(gfloat, n);
+        p->mean[l] = g_new(gfloat, n);
+        p->count[l] = g_new(guint64, n);
+
+        for (i = 0; i < n; i++) {
+            ca = bucket_count(p, l - 1, 2 * i);
+            if (2 * i + 1 < p->len[l - 1]) {
+                cb = bucket_count(p, l - 1, 2 * i + 1);
+                p->min[l][i] = nan_min(p->min[l - 1][2 * i], p->min[l - 1][2 * i + 1]);
+                p->max[l][i] = nan_max(p->max[l - 1][2 * i], p->max[l - 1][2 * i + 1]);
+            }
+            else {
+                cb = 0;
+                p->min[l][i] = p->min[l - 1][2 * i];
+                p->max[l][i] = p->max[l - 1][2 * i];
+            }
+
+            // A short trailing bucket must not weigh as much as a full one
+            p->count[l][i] = ca + cb;
+            if (ca + cb == 0)
+                p->mean[l][i] = NAN;
+            else
+                p->mean[l][i] = ((ca ? ca * (gdouble)p->mean[l - 1][2 * i] : 0) +
+                                 (cb ? cb * (gdouble)p->mean[l - 1][2 * i + 1] : 0)) / (ca + cb);
+        }
+    }
+
+    return p;
+}
+
+typedef struct {
+    gfloat min;
+    gfloat max;
+    gdouble sum;
+    guint64 count;
+} RangeStats;
+
+static void stats_add(RangeStats *st, Pyramid *p, guint l, guint64 b) {
+    guint64 n = bucket_count(p, l, b);
+
+    st->min = nan_min(st->min, p->min[l][b]);
+    st->max = nan_max(st->max, p->max[l][b]);
+    if (n) {
+        st->sum += n * (gdouble)p->mean[l][b];
+        st->count += n;
+    }
+}
+
+// Every row of [r0, r1) exactly once: the level l buckets that lie wholly
+// inside, the partial ones at both ends from the raw samples
+static void range_stats(Pyramid *p, guint l, guint64 r0, guint64 r1, RangeStats *st) {
+    guint64 b0 = (r0 + (1ULL << l) - 1) >> l, b1 = r1 >> l, i;
+
+    st->min = st->max = NAN;
+    st->sum = 0;
+    st->count = 0;
+
+    if (b0 >= b1) {
+        for (i = r0; i < r1; i++)
+            stats_add(st, p, 0, i);
+        return;
+    }
+
+    for (i = r0; i < b0 << l; i++)
+        stats_add(st, p, 0, i);
+    for (i = b0; i < b1; i++)
+        stats_add(st, p, l, i);
+    for (i = b1 << l; i < r1; i++)
+        stats_add(st, p, 0, i);
+}
+
+static Pyramid *get_pyramid(guint sensor) {
+    if (!pyramids[sensor])
+        pyramids[sensor] = pyramid_build(sensor);
+    return pyramids[sensor];
+}
+
+// Pick the finest level whose buckets still cover at least one pixel column,
+// so every column reads exactly one bucket.
+static guint pyramid_level(Pyramid *p, gdouble rows_per_px) {
+    guint l = 0;
+
+    while (l + 1 < p->levels && (gdouble)(1ULL << l) < rows_per_px)
+        l++;
+    return l;
+}
+
+static gchar *format_value(gfloat v) {
+    if (isnan(v))
+        return g_strdup("    ? ? ?");
+    return g_strdup_printf(zlog->sensors[selected].printf_format, v);
+}
+
+static gchar *format_time(guint64 row) {
+    GDateTime *dt;
+    gchar *s;
+    gint64 us;
+
+    row = MIN(row, zlog->rows - 1);
+    us = zlog->start_time + g_array_index(zlog->time, gint64, row);
+    dt = g_date_time_new_from_unix_local(us / G_USEC_PER_SEC);
+    s = g_date_time_format(dt, "%F %T");
+    g_date_time_unref(dt);
+    return s;
+}
+
+static void clamp_view() {
+    view_rows = CLAMP(view_rows, MIN(16, zlog->rows), zlog->rows);
+    view_start = CLAMP(view_start, 0, zlog->rows - view_rows);
+}
+
+static gboolean plot_draw(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    Pyramid *p;
+    gint width, height, x;
+    gdouble rows_per_px, y_min, y_max, y, scale;
+    gfloat vmin, vmax, vmean, smin = NAN, smax = NAN;
+    RangeStats st;
+    guint64 b;
+    guint l;
+    gchar *s1, *s2, *s3, *text;
+
+    width = gtk_widget_get_allocated_width(widget);
+    height = gtk_widget_get_allocated_height(widget);
+
+    cairo_set_source_rgb(cr, 0.12, 0.12, 0.12);
+    cairo_paint(cr);
+
+    if (selected < 0 || width < 2 || !(p = get_pyramid(selected)))
+        return FALSE;
+
+    rows_per_px = view_rows / width;
+    l = pyramid_level(p, rows_per_px);
+
+    // First pass: value range of what gets drawn
+    for (x = 0; x < width; x++) {
+        b = (guint64)(view_start + x * rows_per_px) >> l;
+        if (b >= p->len[l])
+            break;
+        smin = nan_min(smin, p->min[l][b]);
+        smax = nan_max(smax, p->max[l][b]);
+    }
+
+    if (isnan(smin)) {
+        gtk_label_set_text(GTK_LABEL(stats_label), "No data in the visible range");
+        return FALSE;
+    }
+
+    y_min = smin;
+    y_max = smax;
+    if (y_max - y_min < 1e-6) {
+        y_min -= 0.5;
+        y_max += 0.5;
+    }
+    scale = (height - 40) / (y_max - y_min);
+
+    // Second pass: min/max band and mean line, one bucket per column
+    cairo_set_line_width(cr, 1.0);
+    cairo_set_source_rgba(cr, 0.35, 0.6, 0.9, 0.5);
+    for (x = 0; x < width; x++) {
+        b = (guint64)(view_start + x * rows_per_px) >> l;
+        if (b >= p->len[l])
+            break;
+        vmin = p->min[l][b];
+        vmax = p->max[l][b];
+        if (isnan(vmin))
+            continue;
+        cairo_move_to(cr, x + 0.5, 20 + (y_max - vmax) * scale);
+        cairo_line_to(cr, x + 0.5, 20 + (y_max - vmin) * scale + 1);
+    }
+    cairo_stroke(cr);
+
+    cairo_set_source_rgb(cr, 0.95, 0.75, 0.2);
+    for (x = 0; x < width; x++) {
+        b = (guint64)(view_start + x * rows_per_px) >> l;
+        if (b >= p->len[l])
+            break;
+        vmean = p->mean[l][b];
+        if (isnan(vmean))
+            continue;
+        y = 20 + (y_max - vmean) * scale;
+        if (x == 0 || isnan(p->mean[l][(guint64)(view_start + (x - 1) * rows_per_px) >> l]))
+            cairo_move_to(cr, x, y);
+        else
+            cairo_line_to(cr, x, y);
+    }
+    cairo_stroke(cr);
+
+    // Labels
+    cairo_set_source_rgb(cr, 0.85, 0.85, 0.85);
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 11);
+
+    s1 = format_value(smax);
+    cairo_move_to(cr, 4, 14);
+    cairo_show_text(cr, s1);
+    g_free(s1);
+
+    s1 = format_value(smin);
+    cairo_move_to(cr, 4, height - 24);
+    cairo_show_text(cr, s1);
+    g_free(s1);
+
+    s1 = format_time(view_start);
+    cairo_move_to(cr, 4, height - 6);
+    cairo_show_text(cr, s1);
+    g_free(s1);
+
+    s1 = format_time(view_start + view_rows - 1);
+    cairo_move_to(cr, width - 7 * strlen(s1) - 4, height - 6);
+    cairo_show_text(cr, s1);
+    g_free(s1);
+
+    // Columns can share a bucket, the stats count each visible row once
+    range_stats(p, l, view_start, MIN((guint64)ceil(view_start + view_rows), zlog->rows), &st);
+    s1 = format_value(st.min);
+    s2 = format_value(st.count ? st.sum / st.count : NAN);
+    s3 = format_value(st.max);
+    text = g_strdup_printf("%s    Min:%s   Mean:%s   Max:%s",
+                           zlog->sensors[selected].label, s1, s2, s3);
+    gtk_label_set_text(GTK_LABEL(stats_label), text);
+    g_free(text);
+    g_free(s1);
+    g_free(s2);
+    g_free(s3);
+
+    return FALSE;
+}
+
+static gboolean plot_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data) {
+    gdouble factor, anchor;
+    gint width = gtk_widget_get_allocated_width(widget);
+
+    if (event->direction == GDK_SCROLL_UP)
+        factor = 0.8;
+    else if (event->direction == GDK_SCROLL_DOWN)
+        factor = 1.25;
+    else if (event->direction == GDK_SCROLL_SMOOTH && event->delta_y != 0)
+        factor = event->delta_y < 0 ? 0.8 : 1.25;
+    else
+        return FALSE;
+
+    // Keep the row under the pointer in place
+    anchor = view_start + event->x / MAX(width, 1) * view_rows;
+    view_rows *= factor;
+    view_start = anchor - event->x / MAX(width, 1) * view_rows;
+    clamp_view();
+
+    gtk_widget_queue_draw(widget);
+    return TRUE;
+}
+
+static gboolean plot_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    if (event->button == 1)
+        drag_x = event->x;
+    return TRUE;
+}
+
+static gboolean plot_button_release(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    if (event->button == 1)
+        drag_x = -1;
+    return TRUE;
+}
+
+static gboolean plot_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data) {
+    gint width = gtk_widget_get_allocated_width(widget);
+
+    if (drag_x < 0)
+        return FALSE;
+
+    view_start -= (event->x - drag_x) / MAX(width, 1) * view_rows;
+    drag_x = event->x;
+    clamp_view();
+
+    gtk_widget_queue_draw(widget);
+    return TRUE;
+}
+
+static void reset_btn_clicked(GtkButton *button, gpointer user_data) {
+    view_start = 0;
+    view_rows = zlog->rows;
+    gtk_widget_queue_draw(plot);
+}
+
+static void selection_changed(GtkTreeSelection *selection, gpointer user_data) {
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COLUMN_INDEX, &selected, -1);
+        gtk_widget_queue_draw(plot);
+    }
+}
+
+static GtkWidget *create_sensor_list() {
+    GtkListStore *store;
+    GtkTreeIter iter;
+    GtkWidget *treeview;
+    GtkCellRenderer *renderer;
+    GtkTreeViewColumn *column;
+    guint i;
+
+    store = gtk_list_store_new(NUM_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT);
+    for (i = 0; i < zlog->n_sensors; i++) {
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+                           COLUMN_NAME,  zlog->sensors[i].label,
+                           COLUMN_HINT,  zlog->sensors[i].hint,
+                           COLUMN_INDEX, i,
+                           -1);
+    }
+
+    treeview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+    gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(treeview), COLUMN_HINT);
+    g_object_unref(store);
+
+    renderer = gtk_cell_renderer_text_new();
+    column = gtk_tree_view_column_new_with_attributes("Sensor", renderer,
+                                                     "text", COLUMN_NAME,
+                                                     NULL);
+    g_object_set(renderer, "family", "monotype", NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(treeview), column);
+
+    g_signal_connect(gtk_tree_view_get_selection(GTK_TREE_VIEW(treeview)), "changed",
+                     G_CALLBACK(selection_changed), NULL);
+    return treeview;
+}
+
+int start_viewer(const gchar *filename) {
+    GtkWidget *header;
+    GtkWidget *reset_btn;
+    GtkWidget *paned;
+    GtkWidget *sw;
+    GtkWidget *vbox;
+    GtkWidget *dialog;
+    gchar *basename;
+
+    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_position(GTK_WINDOW(window), GTK_WIN_POS_CENTER);
+    gtk_window_set_default_size(GTK_WINDOW(window), 1000, 500);
+    g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
+
+    zlog = zmlog_reader_open(filename);
+    if (!zlog || zlog->rows == 0) {
+        dialog = gtk_message_dialog_new(GTK_WINDOW (window),
+                                        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+                                        GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                        "Unable to read log file %s", filename);
+        gtk_dialog_run(GTK_DIALOG(dialog));
+        gtk_widget_destroy(dialog);
+        if (zlog)
+            zmlog_reader_close(zlog);
+        return 1;
+    }
+
+    pyramids = g_new0(Pyramid*, zlog->n_sensors);
+    view_rows = zlog->rows;
+
+    header = gtk_header_bar_new();
+    gtk_header_bar_set_show_close_button(GTK_HEADER_BAR (header), TRUE);
+    gtk_header_bar_set_title(GTK_HEADER_BAR (header), "Zen monitor");
+    basename = g_path_get_basename(filename);
+    gtk_header_bar_set_subtitle(GTK_HEADER_BAR (header), basename);
+    g_free(basename);
+    gtk_window_set_titlebar(GTK_WINDOW (window), header);
+
+    reset_btn = gtk_button_new();
+    gtk_container_add(GTK_CONTAINER(reset_btn), gtk_image_new_from_icon_name("zoom-fit-best", GTK_ICON_SIZE_BUTTON));
+    gtk_widget_set_tooltip_text(reset_btn, "Show whole recording");
+    gtk_header_bar_pack_start(GTK_HEADER_BAR(header), reset_btn);
+    g_signal_connect(reset_btn, "clicked", G_CALLBACK(reset_btn_clicked), NULL);
+
+    paned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
+    gtk_container_add(GTK_CONTAINER(window), paned);
+
+    sw = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW(sw), GTK_SHADOW_ETCHED_IN);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW (sw), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    gtk_container_add(GTK_CONTAINER(sw), create_sensor_list());
+    gtk_paned_pack1(GTK_PANED(paned), sw, FALSE, FALSE);
+    gtk_paned_set_position(GTK_PANED(paned), 300);
+
+    vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+    gtk_paned_pack2(GTK_PANED(paned), vbox, TRUE, FALSE);
+
+    plot = gtk_drawing_area_new();
+    gtk_widget_add_events(plot, GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK | GDK_BUTTON_PRESS_MASK |
+                                GDK_BUTTON_RELEASE_MASK | GDK_BUTTON1_MOTION_MASK);
+    g_signal_connect(plot, "draw", G_CALLBACK(plot_draw), NULL);
+    g_signal_connect(plot, "scroll-event", G_CALLBACK(plot_scroll), NULL);
+    g_signal_connect(plot, "button-press-event", G_CALLBACK(plot_button_press), NULL);
+    g_signal_connect(plot, "button-release-event", G_CALLBACK(plot_button_release), NULL);
+    g_signal_connect(plot, "motion-notify-event", G_CALLBACK(plot_motion), NULL);
+    gtk_box_pack_start(GTK_BOX(vbox), plot, TRUE, TRUE, 0);
+
+    stats_label = gtk_label_new("Select a sensor");
+    gtk_box_pack_start(GTK_BOX(vbox), stats_label, FALSE, FALSE, 4);
+
+    gtk_widget_show_all(window);
+    gtk_main();
+    return 0;
+}
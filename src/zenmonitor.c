@@ -3,17 +3,28 @@
 #include <string.h>
 #include <stdlib.h>
 #include "zenmonitor.h"
-#include "zenpower.h"
+#include "hwmon.h"
 #include "msr.h"
 #include "os.h"
+#include "plugins.h"
+#include "derived.h"
+#include "thermal.h"
 #include "gui.h"
+#include "burst.h"
+#include "record.h"
+#include "viewer.h"
+#include "tui.h"
+#include "remote.h"
+#include "server.h"
+#include "alerts.h"
+#include "manifest.h"
 
 #define AMD_STRING "AuthenticAMD"
 #define ZEN_FAMILY 0x17
 
 // AMD PPR = https://www.amd.com/system/files/TechDocs/54945_PPR_Family_17h_Models_00h-0Fh.pdf
 
-gboolean check_zen() {
+static gboolean detect_zen() {
     guint32 eax = 0, ebx = 0, ecx = 0, edx = 0, ext_family;
     char vendor[13];
 
@@ -38,6 +49,16 @@ gboolean check_zen() {
     return TRUE;
 }
 
+// Sources initialise in parallel and all ask, CPUID runs only once
+gboolean check_zen() {
+    static gsize zen = 0;
+
+    if (g_once_init_enter(&zen))
+        g_once_init_leave(&zen, detect_zen() ? 2 : 1);
+
+    return zen == 2;
+}
+
 gchar *cpu_model() {
     guint32 eax = 0, ebx = 0, ecx = 0, edx = 0;
     char model[48];
@@ -65,7 +86,7 @@ gchar *cpu_model() {
     return g_strdup(g_strchomp(model));
 }
 
-guint get_core_count() {
+static guint count_cores() {
     guint eax = 0, ebx = 0, ecx = 0, edx = 0;
     guint logical_cpus, threads_per_code;
 
@@ -83,10 +104,19 @@ guint get_core_count() {
     return logical_cpus / threads_per_code;
 }
 
+guint get_core_count() {
+    static gsize cores = 0;
+
+    if (g_once_init_enter(&cores))
+        g_once_init_leave(&cores, count_cores() + 1);
+
+    return cores - 1;
+}
+
 static SensorSource sensor_sources[] = {
     {
-        "zenpower",
-        zenpower_init, zenpower_get_sensors, zenpower_update, zenpower_clear_minmax,
+        "hwmon",
+        hwmon_init, hwmon_get_sensors, hwmon_update, hwmon_clear_minmax,
         FALSE, NULL
     },
     {
@@ -99,28 +129,265 @@ static SensorSource sensor_sources[] = {
         os_init, os_get_sensors, os_update, os_clear_minmax,
         FALSE, NULL
     },
+    {
+        "plugins",
+        plugins_init, plugins_get_sensors, plugins_update, plugins_clear_minmax,
+        FALSE, NULL
+    },
+    {
+        "derived",
+        derived_init, derived_get_sensors, derived_update, derived_clear_minmax,
+        FALSE, NULL, TRUE
+    },
+    {
+        "thermal",
+        thermal_init, thermal_get_sensors, thermal_update, thermal_clear_minmax,
+        FALSE, NULL, TRUE
+    },
+    {
+        NULL
+    }
+};
+
+static SensorSource remote_sensor_sources[] = {
+    {
+        "remote",
+        remote_init, remote_get_sensors, remote_update, remote_clear_minmax,
+        FALSE, NULL
+    },
     {
         NULL
     }
 };
 
 SensorInit *sensor_init_new() {
-    return g_new0(SensorInit, 1);
+    SensorInit *s = g_new0(SensorInit, 1);
+    s->node = -1;
+    s->ccx = -1;
+    s->core = -1;
+    return s;
 }
 
 void sensor_init_free(SensorInit *s) {
     if (s) {
         g_free(s->label);
         g_free(s->hint);
+        g_slist_free(s->deps);
         g_free(s);
     }
 }
 
+gboolean sensor_label_matches(const gchar *label, const gchar *key) {
+    gchar *lc_label, *lc_key;
+    gboolean result;
+
+    lc_label = g_utf8_strdown(label, -1);
+    lc_key = g_utf8_strdown(key, -1);
+
+    result = (g_strrstr(lc_label, lc_key) != NULL);
+
+    g_free(lc_label);
+    g_free(lc_key);
+
+    return result;
+}
+
+// Format strings from a file or a socket, make sure they hold exactly one
+// float conversion before they are ever handed to printf.
+gboolean sensor_format_is_safe(const gchar *fmt) {
+    guint conversions = 0;
+    const gchar *p;
+
+    for (p = fmt; *p; p++) {
+        if (*p != '%')
+            continue;
+        if (*++p == '%')
+            continue;
+        while (*p && strchr("-+ #0", *p))
+            p++;
+        while (g_ascii_isdigit(*p))
+            p++;
+        if (*p == '.') {
+            p++;
+            while (g_ascii_isdigit(*p))
+                p++;
+        }
+        if (*p != 'f' || ++conversions > 1)
+            return FALSE;
+    }
+    return conversions == 1;
+}
+
+// For computed sensors, ERROR_VALUE leaves min/max alone
+void sensor_track(gfloat value, gfloat *current, gfloat *min, gfloat *max) {
+    *current = value;
+    if (value == ERROR_VALUE)
+        return;
+
+    if (*min == ERROR_VALUE || value < *min)
+        *min = value;
+    if (*max == ERROR_VALUE || value > *max)
+        *max = value;
+}
+
+// Sum of the values, ERROR_VALUE if any of them failed
+gfloat sensors_sum(GPtrArray *sensors) {
+    const SensorInit *s;
+    gfloat sum = 0;
+    guint i;
+
+    for (i = 0; i < sensors->len; i++) {
+        s = g_ptr_array_index(sensors, i);
+        if (*s->value == ERROR_VALUE)
+            return ERROR_VALUE;
+        sum += *s->value;
+    }
+    return sum;
+}
+
+gboolean sensor_source_init(SensorSource *source) {
+    if (source->func_init()) {
+        source->sensors = source->func_get_sensors();
+        if (source->sensors != NULL)
+            source->enabled = TRUE;
+    }
+    return source->enabled;
+}
+
+// Sensors of an enabled hardware source, for derived sources
+GSList* sensor_source_sensors(const gchar *drv) {
+    SensorSource *source;
+
+    for (source = sensor_sources; source->drv; source++) {
+        if (source->enabled && strcmp(source->drv, drv) == 0)
+            return source->sensors;
+    }
+    return NULL;
+}
+
+static gpointer source_init_thread(gpointer data) {
+    sensor_source_init(data);
+    return NULL;
+}
+
+// Sources share no state, so the slow parts (MSR sampling, sysfs walks)
+// overlap instead of adding up. Derived sources follow once the others are
+// done. Returns the number of enabled sources.
+guint sensor_sources_init(SensorSource *sources) {
+    SensorSource *source;
+    GPtrArray *threads;
+    guint i, enabled = 0;
+
+    threads = g_ptr_array_new();
+    for (source = sources; source->drv; source++) {
+        if (!source->derived)
+            g_ptr_array_add(threads, g_thread_new(source->drv, source_init_thread, source));
+    }
+
+    for (i = 0; i < threads->len; i++)
+        g_thread_join(g_ptr_array_index(threads, i));
+    g_ptr_array_free(threads, TRUE);
+
+    for (source = sources; source->drv; source++) {
+        if (source->derived)
+            sensor_source_init(source);
+        if (source->enabled)
+            enabled++;
+    }
+
+    manifest_save();
+    return enabled;
+}
+
+void sensor_source_clear_minmax(SensorSource *source) {
+    GSList *node;
+
+    source->func_clear_minmax();
+    for (node = source->sensors; node; node = node->next)
+        ((SensorInit*)node->data)->stale = FALSE;
+}
+
+void sensor_observe(SensorInit *s) {
+    GSList *node;
+
+    if (s->observers++ > 0)
+        return;
+
+    for (node = s->deps; node; node = node->next)
+        sensor_observe(node->data);
+}
+
+void sensor_unobserve(SensorInit *s) {
+    GSList *node;
+
+    if (s->observers == 0 || --s->observers > 0)
+        return;
+
+    for (node = s->deps; node; node = node->next)
+        sensor_unobserve(node->data);
+}
+
+void sensor_source_observe_all(SensorSource *source) {
+    GSList *node;
+
+    for (node = source->sensors; node; node = node->next)
+        sensor_observe(node->data);
+}
+
+// Called by sources before reading a sensor. A sensor that is skipped gets
+// its min/max marked stale, since they may miss what happened meanwhile.
+// Sensors the source has not handed out yet are always read.
+gboolean sensor_needed(SensorInit *s) {
+    if (!s || s->observers > 0)
+        return TRUE;
+
+    s->stale = TRUE;
+    return FALSE;
+}
+
 gboolean display_coreid = 0;
+gint hist_bin_mhz = 100;
+gint thermal_limit = 95;
+static gint burst_seconds = 0;
+static gint burst_rate = 1000;
+static gint burst_cpu = 0;
+static gint msr_bench_ticks = 0;
+static gchar *burst_output = NULL;
+static gchar *record_file = NULL;
+static gint record_interval = 100;
+static gchar *view_file = NULL;
+static gboolean record_procs = FALSE;
+static gboolean tui_mode = FALSE;
+static gboolean server_mode = FALSE;
+static gboolean connect_mode = FALSE;
+static gchar *socket_path = NULL;
+static gint server_interval = 300;
+static gchar *server_user = NULL;
+static gchar *alerts_file = NULL;
+static gchar **plugin_files = NULL;
 
 static GOptionEntry options[] =
 {
     { "coreid", 'c', 0, G_OPTION_ARG_NONE, &display_coreid, "Display core_id instead of core index", NULL },
+    { "tui", 't', 0, G_OPTION_ARG_NONE, &tui_mode, "Run in the terminal instead of opening a window", NULL },
+    { "server", 0, 0, G_OPTION_ARG_NONE, &server_mode, "Run as a privileged sampling server for unprivileged clients", NULL },
+    { "server-interval", 0, 0, G_OPTION_ARG_INT, &server_interval, "Server sampling interval in milliseconds (default 300)", "MS" },
+    { "server-user", 0, 0, G_OPTION_ARG_STRING, &server_user, "User the server runs as once the sensors are open (default nobody)", "USER" },
+    { "connect", 0, 0, G_OPTION_ARG_NONE, &connect_mode, "Read sensors from a running zenmonitor server", NULL },
+    { "socket", 0, 0, G_OPTION_ARG_FILENAME, &socket_path, "Server socket path (default " REMOTE_DEFAULT_SOCKET ")", "PATH" },
+    { "burst", 0, 0, G_OPTION_ARG_INT, &burst_seconds, "Capture core energy and frequency MSRs for N seconds and exit", "N" },
+    { "burst-rate", 0, 0, G_OPTION_ARG_INT, &burst_rate, "Burst sampling rate (max 1000 Hz)", "HZ" },
+    { "burst-cpu", 0, 0, G_OPTION_ARG_INT, &burst_cpu, "CPU to pin the burst sampler thread to", "CPU" },
+    { "burst-output", 0, 0, G_OPTION_ARG_FILENAME, &burst_output, "File to write the burst capture to (CSV)", "FILE" },
+    { "msr-bench", 0, 0, G_OPTION_ARG_INT, &msr_bench_ticks, "Compare serial and per-CCX parallel MSR reads over N passes and exit", "N" },
+    { "record", 0, 0, G_OPTION_ARG_FILENAME, &record_file, "Record all sensors to a binary log file without starting the GUI", "FILE" },
+    { "record-interval", 0, 0, G_OPTION_ARG_INT, &record_interval, "Recording interval in milliseconds (default 100)", "MS" },
+    { "proc-power", 0, 0, G_OPTION_ARG_NONE, &record_procs, "Also record the top power consuming processes", NULL },
+    { "view", 0, 0, G_OPTION_ARG_FILENAME, &view_file, "Open a recorded log file in the viewer", "FILE" },
+    { "hist-bin", 0, 0, G_OPTION_ARG_INT, &hist_bin_mhz, "Frequency residency bin width in MHz (default 100)", "MHZ" },
+    { "thermal-limit", 0, 0, G_OPTION_ARG_INT, &thermal_limit, "Temperature the thermal headroom prediction works towards (default 95)", "C" },
+    { "alerts", 0, 0, G_OPTION_ARG_FILENAME, &alerts_file, "Load alert rules from FILE", "FILE" },
+    { "plugin", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &plugin_files, "Load a sensor source plugin, may be repeated", "FILE" },
     { NULL }
 };
 
@@ -128,14 +395,61 @@ int main (int argc, char *argv[])
 {
     GError *error = NULL;
     GOptionContext *context;
+    SensorSource *sources = sensor_sources;
 
     context = g_option_context_new ("- Zenmonitor display options");
     g_option_context_add_main_entries(context, options, NULL);
-    g_option_context_add_group(context, gtk_get_option_group (TRUE));
+    g_option_context_add_group(context, gtk_get_option_group (FALSE));
     if (!g_option_context_parse(context, &argc, &argv, &error)) {
         g_print ("option parsing failed: %s\n", error->message);
         exit (1);
     }
 
-    start_gui(sensor_sources);
+    // Headless modes have no window to show the error in
+    if ((server_mode || burst_seconds > 0 || msr_bench_ticks > 0 || record_file || tui_mode) && !check_zen()) {
+        g_printerr("Zen CPU not detected!\n");
+        exit (1);
+    }
+
+    if (alerts_file && !alerts_load(alerts_file))
+        exit (1);
+
+    plugins_set_files(plugin_files);
+
+    if (!socket_path)
+        socket_path = g_strdup(REMOTE_DEFAULT_SOCKET);
+
+    if (server_mode) {
+        return server_run(sensor_sources, socket_path, MAX(server_interval, 10),
+                          server_user ? server_user : "nobody") ? 0 : 1;
+    }
+
+    if (connect_mode) {
+        remote_set_socket(socket_path);
+        sources = remote_sensor_sources;
+    }
+
+    if (msr_bench_ticks > 0) {
+        return msr_bench(msr_bench_ticks) ? 0 : 1;
+    }
+
+    if (burst_seconds > 0) {
+        return burst_capture(burst_seconds, burst_rate, burst_cpu,
+                             burst_output ? burst_output : "zenmonitor-burst.csv") ? 0 : 1;
+    }
+
+    if (record_file) {
+        return record_run(sources, record_file, MAX(record_interval, 1), record_procs) ? 0 : 1;
+    }
+
+    if (tui_mode) {
+        return start_tui(sources);
+    }
+
+    gtk_init(&argc, &argv);
+
+    if (view_file)
+        return start_viewer(view_file);
+
+    start_gui(sources);
 }
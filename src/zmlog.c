@@ -0,0 +1,470 @@
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "zenmonitor.h"
+#include "procpower.h"
+#include "freqhist.h"
+#include "zmlog.h"
+
+// On-disk layout is described in docs/log-format.md
+
+struct ZmLogWriter {
+    FILE *file;
+    guint sensors;
+    guint rows;
+    guint chunk_rows;
+    gint64 start_mono;
+    const gfloat **values;      // sensors
+    gint64 *time;               // chunk_rows, us since start
+    gfloat *data;               // sensors * chunk_rows, column-major
+    GByteArray *buf;
+};
+
+static void put_u16(GByteArray *buf, guint16 v) {
+    guint8 b[2] = { v, v >> 8 };
+    g_byte_array_append(buf, b, 2);
+}
+
+static void set_u32(guint8 *p, guint32 v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void put_u32(GByteArray *buf, guint32 v) {
+    guint8 b[4];
+    set_u32(b, v);
+    g_byte_array_append(buf, b, 4);
+}
+
+static void put_u64(GByteArray *buf, guint64 v) {
+    put_u32(buf, (guint32)v);
+    put_u32(buf, (guint32)(v >> 32));
+}
+
+static void put_varint(GByteArray *buf, guint64 v) {
+    guint8 b[10];
+    guint n = 0;
+
+    while (v >= 0x80) {
+        b[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    b[n++] = v;
+    g_byte_array_append(buf, b, n);
+}
+
+static void put_str(GByteArray *buf, const gchar *s) {
+    gsize len = s ? MIN(strlen(s), G_MAXUINT16) : 0;
+
+    put_u16(buf, len);
+    g_byte_array_append(buf, (const guint8*)s, len);
+}
+
+static guint32 float_bits(gfloat f) {
+    guint32 u;
+    memcpy(&u, &f, sizeof u);
+    return u;
+}
+
+static gboolean write_buf(ZmLogWriter *w) {
+    gboolean ok;
+
+    ok = fwrite(w->buf->data, 1, w->buf->len, w->file) == w->buf->len;
+    ok = ok && fflush(w->file) == 0;
+    g_byte_array_set_size(w->buf, 0);
+    return ok;
+}
+
+static gboolean flush_chunk(ZmLogWriter *w) {
+    guint i, r, len_pos, col_pos, col_len;
+    guint32 prev, cur;
+    const gfloat *col;
+
+    // Blocks queued since the last chunk (e.g. PROC) are written along with it
+    if (w->rows == 0)
+        return write_buf(w);
+
+    g_byte_array_append(w->buf, (const guint8*)ZMLOG_TAG_DATA, 4);
+    len_pos = w->buf->len;
+    put_u32(w->buf, 0);
+
+    put_u32(w->buf, w->rows);
+    put_varint(w->buf, w->time[0]);
+    for (r = 1; r < w->rows; r++)
+        put_varint(w->buf, w->time[r] - w->time[r - 1]);
+
+    // Column length table, filled in once the columns are encoded
+    col_pos = w->buf->len;
+    for (i = 0; i < w->sensors; i++)
+        put_u32(w->buf, 0);
+
+    for (i = 0; i < w->sensors; i++) {
+        col = &w->data[(gsize)i * w->chunk_rows];
+        col_len = w->buf->len;
+        prev = 0;
+        for (r = 0; r < w->rows; r++) {
+            cur = float_bits(col[r]);
+            put_varint(w->buf, cur ^ prev);
+            prev = cur;
+        }
+        col_len = w->buf->len - col_len;
+        set_u32(&w->buf->data[col_pos + i * 4], col_len);
+    }
+
+    set_u32(&w->buf->data[len_pos], w->buf->len - len_pos - 4);
+
+    w->rows = 0;
+    return write_buf(w);
+}
+
+ZmLogWriter *zmlog_writer_new(const gchar *filename, SensorSource *sources, guint interval_us) {
+    ZmLogWriter *w;
+    SensorSource *source;
+    const SensorInit *data;
+    GSList *node;
+    guint i;
+
+    w = g_new0(ZmLogWriter, 1);
+    w->file = fopen(filename, "wb");
+    if (!w->file) {
+        g_free(w);
+        return NULL;
+    }
+
+    for (source = sources; source->drv; source++) {
+        if (source->enabled)
+            w->sensors += g_slist_length(source->sensors);
+    }
+
+    w->chunk_rows = ZMLOG_CHUNK_ROWS;
+    w->start_mono = g_get_monotonic_time();
+    w->values = g_new(const gfloat*, w->sensors);
+    w->time = g_new(gint64, w->chunk_rows);
+    w->data = g_new(gfloat, (gsize)w->sensors * w->chunk_rows);
+    w->buf = g_byte_array_sized_new(64 * 1024);
+
+    g_byte_array_append(w->buf, (const guint8*)ZMLOG_MAGIC, 6);
+    put_u16(w->buf, ZMLOG_VERSION);
+    put_u64(w->buf, g_get_real_time());
+    put_u32(w->buf, interval_us);
+    put_u32(w->buf, w->sensors);
+    put_u32(w->buf, w->chunk_rows);
+
+    i = 0;
+    for (source = sources; source->drv; source++) {
+        if (!source->enabled)
+            continue;
+
+        for (node = source->sensors; node; node = node->next) {
+            data = (SensorInit*)node->data;
+            put_str(w->buf, source->drv);
+            put_str(w->buf, data->label);
+            put_str(w->buf, data->hint);
+            put_str(w->buf, data->printf_format);
+            w->values[i++] = data->value;
+        }
+    }
+
+    if (!write_buf(w)) {
+        zmlog_writer_close(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+gboolean zmlog_writer_append(ZmLogWriter *w) {
+    guint i;
+
+    w->time[w->rows] = g_get_monotonic_time() - w->start_mono;
+    for (i = 0; i < w->sensors; i++)
+        w->data[(gsize)i * w->chunk_rows + w->rows] = *w->values[i];
+
+    if (++w->rows < w->chunk_rows)
+        return TRUE;
+
+    return flush_chunk(w);
+}
+
+void zmlog_writer_append_procs(ZmLogWriter *w, const ProcPower *top, guint n) {
+    guint i, len_pos;
+
+    g_byte_array_append(w->buf, (const guint8*)ZMLOG_TAG_PROC, 4);
+    len_pos = w->buf->len;
+    put_u32(w->buf, 0);
+
+    put_varint(w->buf, g_get_monotonic_time() - w->start_mono);
+    put_u16(w->buf, n);
+    for (i = 0; i < n; i++) {
+        put_u32(w->buf, top[i].pid);
+        put_str(w->buf, top[i].comm);
+        put_u32(w->buf, float_bits(top[i].power));
+    }
+
+    set_u32(&w->buf->data[len_pos], w->buf->len - len_pos - 4);
+}
+
+void zmlog_writer_append_hist(ZmLogWriter *w, const FreqHist *h) {
+    guint i, c, len_pos, column;
+    const guint64 *t;
+
+    g_byte_array_append(w->buf, (const guint8*)ZMLOG_TAG_HIST, 4);
+    len_pos = w->buf->len;
+    put_u32(w->buf, 0);
+
+    put_varint(w->buf, g_get_monotonic_time() - w->start_mono);
+    put_u16(w->buf, h->bin_mhz);
+    put_u16(w->buf, h->bins);
+    put_u16(w->buf, h->cores);
+
+    for (c = 0; c < h->cores; c++) {
+        // Column of the frequency sensor the row was built from
+        column = G_MAXUINT32;
+        for (i = 0; i < w->sensors; i++) {
+            if (w->values[i] == h->sensors[c]->value) {
+                column = i;
+                break;
+            }
+        }
+        put_u32(w->buf, column);
+
+        t = &h->time[(gsize)c * h->bins];
+        for (i = 0; i < h->bins; i++)
+            put_varint(w->buf, t[i] / 1000);
+    }
+
+    set_u32(&w->buf->data[len_pos], w->buf->len - len_pos - 4);
+}
+
+gboolean zmlog_writer_close(ZmLogWriter *w) {
+    gboolean ok;
+
+    ok = flush_chunk(w);
+    ok = fclose(w->file) == 0 && ok;
+
+    g_byte_array_free(w->buf, TRUE);
+    g_free(w->values);
+    g_free(w->time);
+    g_free(w->data);
+    g_free(w);
+    return ok;
+}
+
+typedef struct {
+    const guint8 *p;
+    const guint8 *end;
+    gboolean ok;
+} Cursor;
+
+static guint64 get_bytes(Cursor *c, guint n) {
+    guint64 v = 0;
+    guint i;
+
+    if (!c->ok || c->end - c->p < n) {
+        c->ok = FALSE;
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+        v |= (guint64)c->p[i] << (8 * i);
+    c->p += n;
+    return v;
+}
+
+static guint64 get_varint(Cursor *c) {
+    guint64 v = 0;
+    guint shift = 0;
+
+    while (c->ok && c->p < c->end && shift < 64) {
+        v |= (guint64)(*c->p & 0x7F) << shift;
+        if (!(*c->p++ & 0x80))
+            return v;
+        shift += 7;
+    }
+    c->ok = FALSE;
+    return 0;
+}
+
+static gchar *get_str(Cursor *c) {
+    guint len = get_bytes(c, 2);
+    gchar *s;
+
+    if (!c->ok || c->end - c->p < len) {
+        c->ok = FALSE;
+        return NULL;
+    }
+    s = g_strndup((const gchar*)c->p, len);
+    c->p += len;
+    return s;
+}
+
+static gboolean read_header(ZmLogReader *r, Cursor *c) {
+    ZmLogSensor *s;
+    guint i;
+
+    if (c->end - c->p < 6 || memcmp(c->p, ZMLOG_MAGIC, 6) != 0)
+        return FALSE;
+    c->p += 6;
+
+    if (get_bytes(c, 2) != ZMLOG_VERSION)
+        return FALSE;
+
+    r->start_time = get_bytes(c, 8);
+    r->interval = get_bytes(c, 4);
+    r->n_sensors = get_bytes(c, 4);
+    r->chunk_rows = get_bytes(c, 4);
+    if (!c->ok || r->n_sensors == 0 || r->chunk_rows == 0 || r->chunk_rows > ZMLOG_MAX_CHUNK_ROWS)
+        return FALSE;
+
+    // Four length prefixes per sensor at least, before allocating for them
+    if ((gsize)(c->end - c->p) / 8 < r->n_sensors)
+        return FALSE;
+
+    r->sensors = g_new0(ZmLogSensor, r->n_sensors);
+    for (i = 0; i < r->n_sensors && c->ok; i++) {
+        s = &r->sensors[i];
+        s->source = get_str(c);
+        s->label = get_str(c);
+        s->hint = get_str(c);
+        s->printf_format = get_str(c);
+        if (c->ok && !sensor_format_is_safe(s->printf_format)) {
+            g_free(s->printf_format);
+            s->printf_format = g_strdup(" %8.3f");
+        }
+    }
+
+    return c->ok;
+}
+
+static gboolean read_chunk(ZmLogReader *r, const guint8 *payload, guint length) {
+    Cursor c = { payload, payload + length, TRUE };
+    ZmLogChunk chunk;
+    gsize avail, len;
+    gint64 t;
+    guint i;
+
+    // Every row takes at least one byte of time varint
+    chunk.rows = get_bytes(&c, 4);
+    if (chunk.rows == 0 || chunk.rows > r->chunk_rows || chunk.rows > length)
+        return FALSE;
+
+    chunk.first_row = r->rows;
+    g_array_set_size(r->time, r->rows + chunk.rows);
+
+    t = get_varint(&c);
+    g_array_index(r->time, gint64, r->rows) = t;
+    for (i = 1; i < chunk.rows; i++) {
+        t += get_varint(&c);
+        g_array_index(r->time, gint64, r->rows + i) = t;
+    }
+
+    if (!c.ok || (gsize)(c.end - c.p) < (gsize)r->n_sensors * 4) {
+        g_array_set_size(r->time, r->rows);
+        return FALSE;
+    }
+
+    // Each column must fit in what is left, a wrapping sum must not pass
+    chunk.columns = c.p + (gsize)r->n_sensors * 4;
+    avail = c.end - chunk.columns;
+    chunk.col_offset = g_new(guint32, r->n_sensors + 1);
+    chunk.col_offset[0] = 0;
+    for (i = 0; i < r->n_sensors && c.ok; i++) {
+        len = get_bytes(&c, 4);
+        if (len > avail - chunk.col_offset[i])
+            c.ok = FALSE;
+        else
+            chunk.col_offset[i + 1] = chunk.col_offset[i] + len;
+    }
+
+    if (!c.ok) {
+        g_free(chunk.col_offset);
+        g_array_set_size(r->time, r->rows);
+        return FALSE;
+    }
+
+    g_array_append_val(r->chunks, chunk);
+    r->rows += chunk.rows;
+    return TRUE;
+}
+
+ZmLogReader *zmlog_reader_open(const gchar *filename) {
+    ZmLogReader *r;
+    Cursor c;
+    const guint8 *tag;
+    guint32 length;
+
+    r = g_new0(ZmLogReader, 1);
+    r->map = g_mapped_file_new(filename, FALSE, NULL);
+    if (!r->map) {
+        g_free(r);
+        return NULL;
+    }
+
+    c.p = (const guint8*)g_mapped_file_get_contents(r->map);
+    c.end = c.p + g_mapped_file_get_length(r->map);
+    c.ok = TRUE;
+
+    r->chunks = g_array_new(FALSE, FALSE, sizeof(ZmLogChunk));
+    r->time = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    if (!read_header(r, &c)) {
+        zmlog_reader_close(r);
+        return NULL;
+    }
+
+    while (c.end - c.p >= 8) {
+        tag = c.p;
+        c.p += 4;
+        length = get_bytes(&c, 4);
+        if (c.end - c.p < length)
+            break;
+
+        if (memcmp(tag, ZMLOG_TAG_DATA, 4) == 0 && !read_chunk(r, c.p, length))
+            break;
+
+        c.p += length;
+    }
+
+    return r;
+}
+
+gboolean zmlog_reader_column(ZmLogReader *r, guint chunk, guint sensor, gfloat *values) {
+    ZmLogChunk *ch = &g_array_index(r->chunks, ZmLogChunk, chunk);
+    Cursor c;
+    guint32 bits = 0;
+    guint i;
+
+    c.p = ch->columns + ch->col_offset[sensor];
+    c.end = ch->columns + ch->col_offset[sensor + 1];
+    c.ok = TRUE;
+
+    for (i = 0; i < ch->rows; i++) {
+        bits ^= (guint32)get_varint(&c);
+        memcpy(&values[i], &bits, sizeof bits);
+    }
+
+    return c.ok;
+}
+
+void zmlog_reader_close(ZmLogReader *r) {
+    guint i;
+
+    for (i = 0; i < r->chunks->len; i++)
+        g_free(g_array_index(r->chunks, ZmLogChunk, i).col_offset);
+
+    if (r->sensors) {
+        for (i = 0; i < r->n_sensors; i++) {
+            g_free(r->sensors[i].source);
+            g_free(r->sensors[i].label);
+            g_free(r->sensors[i].hint);
+            g_free(r->sensors[i].printf_format);
+        }
+        g_free(r->sensors);
+    }
+
+    g_array_free(r->chunks, TRUE);
+    g_array_free(r->time, TRUE);
+    g_mapped_file_unref(r->map);
+    g_free(r);
+}
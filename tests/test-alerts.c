@@ -0,0 +1,142 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+#include "zenmonitor.h"
+#include "alerts.h"
+
+// alerts.c only needs observing from zenmonitor.c
+void sensor_observe(SensorInit *s) {
+    s->observers++;
+}
+
+static gfloat temp = 40, temp_max = 40;
+static SensorInit temp_sensor = {
+    .label = "Temp", .value = &temp, .min = &temp, .max = &temp_max, .printf_format = " %6.1f C"
+};
+static SensorSource sources[2];
+
+static gboolean load(const gchar *rules) {
+    gchar *path;
+    gboolean ok;
+    gint fd;
+
+    fd = g_file_open_tmp("alerts-XXXXXX", &path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+    g_assert_true(g_file_set_contents(path, rules, -1, NULL));
+
+    ok = alerts_load(path);
+    g_unlink(path);
+    g_free(path);
+    return ok;
+}
+
+static void bind(void) {
+    sources[0].drv = "test";
+    sources[0].enabled = TRUE;
+    sources[0].sensors = g_slist_prepend(NULL, &temp_sensor);
+    temp_sensor.observers = 0;
+    alerts_bind(sources);
+    g_slist_free(sources[0].sensors);
+}
+
+static void test_valid(void) {
+    g_assert_true(load("[hot]\nsensor=Temp\nabove=90\nhysteresis=3\nfor=5\naction=log;notify\n"));
+    g_assert_true(load("[cold]\nsensor=Temp\nbelow = 10 %\n"));
+    g_assert_true(load("[guarded]\nsensor=Temp\nbelow=60%\nwhile=Temp\nwhile-above=10\n"
+                       "action=exec\nexec=/bin/echo \"a b\"\n"));
+    g_assert_true(load("[throttle]\ntype=throttle\ntemperature-limit=90\ndrop=15%\n"));
+    g_assert_true(load(""));
+}
+
+static void test_invalid(void) {
+    const gchar *bad[] = {
+        "[no-sensor]\nabove=90\n",
+        "[no-threshold]\nsensor=Temp\n",
+        "[not-a-number]\nsensor=Temp\nabove=hot\n",
+        "[trailing]\nsensor=Temp\nabove=90 C\n",
+        "[guard-threshold]\nsensor=Temp\nabove=90\nwhile=Temp\n",
+        "[action]\nsensor=Temp\nabove=90\naction=log;mail\n",
+        "[exec]\nsensor=Temp\nabove=90\naction=exec\n",
+        "[quote]\nsensor=Temp\nabove=90\naction=exec\nexec=/bin/echo \"a\n",
+        "[type]\ntype=fan\n",
+        "[drop]\ntype=throttle\ndrop=much\n",
+        "not a key file\n",
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(bad); i++) {
+        g_test_message("%s", bad[i]);
+        g_assert_false(load(bad[i]));
+        g_assert_false(alerts_active());
+    }
+}
+
+static void test_bind(void) {
+    g_assert_true(load("[missing]\nsensor=Fan\nabove=90\n"));
+    bind();
+    g_assert_false(alerts_active());
+
+    g_assert_true(load("[hot]\nsensor=Temp\nabove=90\n"));
+    bind();
+    g_assert_true(alerts_active());
+    g_assert_cmpint(temp_sensor.observers, ==, 1);
+
+    // The detector needs the MSR average frequency
+    g_assert_true(load("[throttle]\ntype=throttle\n"));
+    bind();
+    g_assert_false(alerts_active());
+}
+
+// Fires above 90, holds inside the hysteresis band, clears below 87
+static void test_hysteresis(void) {
+    if (g_test_subprocess()) {
+        g_assert_true(load("[hot]\nsensor=Temp\nabove=90\nhysteresis=3\naction=log\n"));
+        bind();
+
+        temp = 89;
+        alerts_evaluate();
+        temp = 95;
+        alerts_evaluate();
+        temp = 88;
+        alerts_evaluate();
+        temp = 86;
+        alerts_evaluate();
+        return;
+    }
+
+    g_test_trap_subprocess(NULL, 0, 0);
+    g_test_trap_assert_passed();
+    g_test_trap_assert_stderr("alert: [hot] Temp is 95.0 C\nalert: [hot] cleared: Temp is 86.0 C\n");
+}
+
+// Percentages are of the sensor's max
+static void test_relative(void) {
+    if (g_test_subprocess()) {
+        g_assert_true(load("[rel]\nsensor=Temp\nabove=50%\naction=log\n"));
+        bind();
+
+        temp_max = 100;
+        temp = 45;
+        alerts_evaluate();
+        temp = 55;
+        alerts_evaluate();
+        return;
+    }
+
+    g_test_trap_subprocess(NULL, 0, 0);
+    g_test_trap_assert_passed();
+    g_test_trap_assert_stderr("alert: [rel] Temp is 55.0 C\n");
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/alerts/parse/valid", test_valid);
+    g_test_add_func("/alerts/parse/invalid", test_invalid);
+    g_test_add_func("/alerts/bind", test_bind);
+    g_test_add_func("/alerts/evaluate/hysteresis", test_hysteresis);
+    g_test_add_func("/alerts/evaluate/relative", test_relative);
+
+    return g_test_run();
+}
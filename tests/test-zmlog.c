@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include "zenmonitor.h"
+#include "zmlog.h"
+
+#define TEST_SENSORS 3
+#define TEST_ROWS (ZMLOG_CHUNK_ROWS * 2 + 17)
+
+// zmlog.c only needs the format check from zenmonitor.c
+gboolean sensor_format_is_safe(const gchar *fmt) {
+    return strstr(fmt, "%n") == NULL;
+}
+
+static gfloat values[TEST_SENSORS];
+static SensorInit inits[TEST_SENSORS];
+static SensorSource sources[2];
+
+// Slow ramps, sign changes, error values and special floats, so the XOR
+// deltas range from zero to all 32 bits
+static gfloat sample(guint sensor, guint row) {
+    switch (sensor) {
+        case 0:  return 40.0f + row / 100.0f;
+        case 1:  return row % 50 == 0 ? ERROR_VALUE : -1.5f * (row % 7);
+        default: return row % 3 == 0 ? INFINITY : row % 3 == 1 ? -0.0f : 1e-30f * row;
+    }
+}
+
+static gchar* write_log(guint rows, const gchar *format) {
+    ZmLogWriter *w;
+    gchar *path;
+    guint i, r;
+    gint fd;
+
+    fd = g_file_open_tmp("zmlog-XXXXXX", &path, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    close(fd);
+
+    memset(sources, 0, sizeof sources);
+    sources[0].drv = "test";
+    sources[0].enabled = TRUE;
+    sources[0].sensors = NULL;
+    for (i = 0; i < TEST_SENSORS; i++) {
+        memset(&inits[i], 0, sizeof inits[i]);
+        inits[i].label = g_strdup_printf("Sensor %u", i);
+        inits[i].hint = "hint";
+        inits[i].value = &values[i];
+        inits[i].printf_format = i == 0 ? format : " %8.3f";
+        sources[0].sensors = g_slist_append(sources[0].sensors, &inits[i]);
+    }
+
+    w = zmlog_writer_new(path, sources, 100000);
+    g_assert_nonnull(w);
+    for (r = 0; r < rows; r++) {
+        for (i = 0; i < TEST_SENSORS; i++)
+            values[i] = sample(i, r);
+        g_assert_true(zmlog_writer_append(w));
+    }
+    g_assert_true(zmlog_writer_close(w));
+
+    for (i = 0; i < TEST_SENSORS; i++)
+        g_free(inits[i].label);
+    g_slist_free(sources[0].sensors);
+    return path;
+}
+
+static void test_round_trip(void) {
+    ZmLogReader *r;
+    ZmLogChunk *ch;
+    gfloat column[ZMLOG_CHUNK_ROWS], expected;
+    gchar *path;
+    guint c, i, row;
+
+    path = write_log(TEST_ROWS, " %8.3f C");
+    r = zmlog_reader_open(path);
+    g_assert_nonnull(r);
+
+    g_assert_cmpuint(r->n_sensors, ==, TEST_SENSORS);
+    g_assert_cmpuint(r->interval, ==, 100000);
+    g_assert_cmpuint(r->chunk_rows, ==, ZMLOG_CHUNK_ROWS);
+    g_assert_cmpuint(r->rows, ==, TEST_ROWS);
+    g_assert_cmpuint(r->chunks->len, ==, 3);
+    g_assert_cmpstr(r->sensors[0].source, ==, "test");
+    g_assert_cmpstr(r->sensors[2].label, ==, "Sensor 2");
+    g_assert_cmpstr(r->sensors[0].printf_format, ==, " %8.3f C");
+
+    for (i = 1; i < r->rows; i++)
+        g_assert_cmpint(g_array_index(r->time, gint64, i), >=, g_array_index(r->time, gint64, i - 1));
+
+    // Bit for bit, -0.0 and infinity included
+    for (c = 0; c < r->chunks->len; c++) {
+        ch = &g_array_index(r->chunks, ZmLogChunk, c);
+        for (i = 0; i < TEST_SENSORS; i++) {
+            g_assert_true(zmlog_reader_column(r, c, i, column));
+            for (row = 0; row < ch->rows; row++) {
+                expected = sample(i, ch->first_row + row);
+                g_assert_cmpmem(&column[row], sizeof(gfloat), &expected, sizeof(gfloat));
+            }
+        }
+    }
+
+    zmlog_reader_close(r);
+    g_unlink(path);
+    g_free(path);
+}
+
+static void test_unsafe_format(void) {
+    ZmLogReader *r;
+    gchar *path;
+
+    path = write_log(5, " %n%8.3f");
+    r = zmlog_reader_open(path);
+    g_assert_nonnull(r);
+    g_assert_cmpstr(r->sensors[0].printf_format, ==, " %8.3f");
+
+    zmlog_reader_close(r);
+    g_unlink(path);
+    g_free(path);
+}
+
+// A recorder killed mid-write leaves a partial last block, which is dropped
+static void test_truncated(void) {
+    ZmLogReader *r;
+    gchar *path, *data;
+    gsize len;
+
+    path = write_log(ZMLOG_CHUNK_ROWS + 10, " %8.3f");
+    g_assert_true(g_file_get_contents(path, &data, &len, NULL));
+    g_assert_true(g_file_set_contents(path, data, len - 3, NULL));
+    g_free(data);
+
+    r = zmlog_reader_open(path);
+    g_assert_nonnull(r);
+    g_assert_cmpuint(r->chunks->len, ==, 1);
+    g_assert_cmpuint(r->rows, ==, ZMLOG_CHUNK_ROWS);
+
+    zmlog_reader_close(r);
+    g_unlink(path);
+    g_free(path);
+}
+
+// Offset of the rows field of the first DATA block
+static gsize first_rows_offset(const gchar *data, gsize len) {
+    const gchar *p = memmem(data, len, ZMLOG_TAG_DATA, 4);
+
+    g_assert_nonnull(p);
+    return p - data + 8;
+}
+
+// More rows than the header allows, more than the block has bytes, none
+static void test_bad_rows(void) {
+    const guint32 bad[] = { ZMLOG_CHUNK_ROWS + 1, ZMLOG_CHUNK_ROWS, 0 };
+    ZmLogReader *r;
+    gchar *path, *data;
+    gsize len, off;
+    guint32 rows;
+    guint i;
+
+    path = write_log(20, " %8.3f");
+    g_assert_true(g_file_get_contents(path, &data, &len, NULL));
+    off = first_rows_offset(data, len);
+
+    for (i = 0; i < G_N_ELEMENTS(bad); i++) {
+        rows = GUINT32_TO_LE(bad[i]);
+        memcpy(data + off, &rows, 4);
+        g_assert_true(g_file_set_contents(path, data, len, NULL));
+        r = zmlog_reader_open(path);
+        g_assert_nonnull(r);
+        g_assert_cmpuint(r->chunks->len, ==, 0);
+        zmlog_reader_close(r);
+    }
+
+    g_free(data);
+    g_unlink(path);
+    g_free(path);
+}
+
+static void test_bad_header(void) {
+    gchar *path, *data;
+    gsize len;
+    guint32 chunk_rows = GUINT32_TO_LE(ZMLOG_MAX_CHUNK_ROWS + 1);
+
+    path = write_log(1, " %8.3f");
+    g_assert_true(g_file_get_contents(path, &data, &len, NULL));
+
+    // chunk_rows sits after magic, version, start time, interval and count
+    memcpy(data + 6 + 2 + 8 + 4 + 4, &chunk_rows, 4);
+    g_assert_true(g_file_set_contents(path, data, len, NULL));
+    g_assert_null(zmlog_reader_open(path));
+
+    g_assert_true(g_file_set_contents(path, "ZMLOG", 5, NULL));
+    g_assert_null(zmlog_reader_open(path));
+
+    g_free(data);
+    g_unlink(path);
+    g_free(path);
+}
+
+int main(int argc, char **argv) {
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/zmlog/round-trip", test_round_trip);
+    g_test_add_func("/zmlog/unsafe-format", test_unsafe_format);
+    g_test_add_func("/zmlog/truncated", test_truncated);
+    g_test_add_func("/zmlog/bad-rows", test_bad_rows);
+    g_test_add_func("/zmlog/bad-header", test_bad_header);
+
+    return g_test_run();
+}